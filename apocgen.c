@@ -0,0 +1,358 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Synthetic object mesh generator
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+/* Local header files */
+#include "apocgen.h"
+#include "bytebuf.h"
+#include "names.h"
+#include "misc.h"
+
+enum {
+  LoadAddress = 0x8f00,
+  MeshIndexAddress = 0x19b6c,
+  MeshIndexOffset = MeshIndexAddress - LoadAddress,
+  DefaultNumObjects = 200,
+  MaxNumVertices = 256,
+  MinNumSides = 3,
+  MaxNumSides = 7,
+  MaxNumPrimitives = MaxNumVertices / MinNumSides,
+  BytesPerPrimitive = 8,
+  NColours = 256,
+  MinRadius = 64,
+  MaxRadius = 4096,
+  MaxCentre = 1 << 16,
+  MaxPercent = 100,
+};
+
+typedef struct {
+  int axis; /* perpendicular to the plane */
+  int32_t depth, centre[2], radius;
+  double phase;
+  int nsides;
+  bool reversed;
+} Polygon;
+
+/* The polygons of the last object generated, from which the next frame of
+   an animated model is made. */
+typedef struct {
+  Polygon polygons[MaxNumPrimitives];
+  unsigned char colours[MaxNumPrimitives];
+  int nprimitives;
+} Frame;
+
+/* xorshift32, so that the same seed generates the same file on any
+   platform */
+static uint32_t next_random(uint32_t * const state)
+{
+  assert(state != NULL);
+
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static int32_t random_range(uint32_t * const state, int32_t const min,
+                            int32_t const max)
+{
+  assert(state != NULL);
+  assert(max >= min);
+
+  return min + (int32_t)(next_random(state) %
+                         ((uint32_t)max - (uint32_t)min + 1));
+}
+
+static bool chance(uint32_t * const state, int const percent)
+{
+  assert(state != NULL);
+  assert(percent >= 0);
+  assert(percent <= MaxPercent);
+
+  return (int)(next_random(state) % MaxPercent) < percent;
+}
+
+void apoc_gen_params_init(ApocGenParams * const params)
+{
+  assert(params != NULL);
+
+  *params = (ApocGenParams){
+    .nobjects = DefaultNumObjects,
+    .index_size = DefaultNumObjects,
+    .min_vertices = 8,
+    .max_vertices = MaxNumVertices,
+    .min_sides = MinNumSides,
+    .max_sides = MaxNumSides,
+    .overlap = 10,
+    .duplicate = 10,
+    .moved = 25,
+    .seed = 1,
+  };
+}
+
+static bool check_params(const ApocGenParams * const params)
+{
+  assert(params != NULL);
+
+  if (params->nobjects < 1) {
+    fputs("Must generate at least one object\n", stderr);
+    return false;
+  }
+
+  if (params->index_size < params->nobjects) {
+    fputs("Index is too small for the objects\n", stderr);
+    return false;
+  }
+
+  if (params->min_sides < MinNumSides || params->max_sides > MaxNumSides ||
+      params->min_sides > params->max_sides) {
+    fprintf(stderr, "Side counts must be between %d and %d\n",
+            MinNumSides, MaxNumSides);
+    return false;
+  }
+
+  if (params->min_vertices < params->max_sides ||
+      params->max_vertices > MaxNumVertices ||
+      params->min_vertices > params->max_vertices) {
+    fprintf(stderr, "Vertex counts must be between %d and %d\n",
+            params->max_sides, MaxNumVertices);
+    return false;
+  }
+
+  if (params->overlap < 0 || params->overlap > MaxPercent ||
+      params->duplicate < 0 || params->duplicate > MaxPercent ||
+      params->moved < 0 || params->moved > MaxPercent) {
+    fputs("Percentages must be between 0 and 100\n", stderr);
+    return false;
+  }
+
+  return true;
+}
+
+static void random_polygon(uint32_t * const state, Polygon * const poly,
+                           int const nsides)
+{
+  assert(state != NULL);
+  assert(poly != NULL);
+
+  poly->axis = random_range(state, 0, 2);
+  poly->depth = random_range(state, -MaxCentre, MaxCentre);
+  poly->centre[0] = random_range(state, -MaxCentre, MaxCentre);
+  poly->centre[1] = random_range(state, -MaxCentre, MaxCentre);
+  poly->radius = random_range(state, MinRadius, MaxRadius);
+  poly->phase = (double)next_random(state) / UINT32_MAX;
+  poly->nsides = nsides;
+  poly->reversed = false;
+}
+
+/* Appends the vertices of a polygon, in order around its edge. */
+static bool add_polygon(ByteBuffer * const buf, const Polygon * const poly)
+{
+  assert(buf != NULL);
+  assert(poly != NULL);
+
+  static const double two_pi = 6.283185307179586;
+  for (int s = 0; s < poly->nsides; ++s) {
+    int const k = poly->reversed ? poly->nsides - s : s;
+    double const angle = two_pi * (poly->phase + (double)k / poly->nsides);
+    int32_t const u = poly->centre[0] +
+                      (int32_t)lround(poly->radius * cos(angle));
+    int32_t const v = poly->centre[1] +
+                      (int32_t)lround(poly->radius * sin(angle));
+    int32_t coords[3];
+    coords[poly->axis] = poly->depth;
+    coords[(poly->axis + 1) % 3] = u;
+    coords[(poly->axis + 2) % 3] = v;
+
+    for (size_t i = 0; i < ARRAY_SIZE(coords); ++i) {
+      if (!byte_buffer_append_le32(buf, (uint32_t)coords[i])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Appends the vertices of a polygon whose first vertex will be vertex
+   number first, and gets the primitive which refers to them. */
+static bool add_primitive(ByteBuffer * const vertices,
+                          const Polygon * const poly, int const first,
+                          unsigned char (* const prim)[BytesPerPrimitive])
+{
+  assert(vertices != NULL);
+  assert(poly != NULL);
+  assert(first >= 0);
+  assert(prim != NULL);
+
+  if (!add_polygon(vertices, poly)) {
+    return false;
+  }
+
+  (*prim)[0] = (unsigned char)poly->nsides;
+  for (int s = 0; s < MaxNumSides; ++s) {
+    (*prim)[1 + s] = s < poly->nsides ? (unsigned char)(first + s) : 0;
+  }
+  return true;
+}
+
+static bool add_object(const ApocGenParams * const params,
+                       uint32_t * const state, Frame * const frame,
+                       bool const next_frame, ByteBuffer * const objects,
+                       ByteBuffer * const vertices)
+{
+  assert(params != NULL);
+  assert(state != NULL);
+  assert(frame != NULL);
+  assert(objects != NULL);
+  assert(vertices != NULL);
+
+  unsigned char prims[MaxNumPrimitives][BytesPerPrimitive];
+  int nvertices = 0, nprimitives = 0;
+
+  byte_buffer_reset(vertices);
+
+  if (next_frame) {
+    /* Polygons which aren't moved have the same vertices as in the
+       previous frame of the animation */
+    for (; nprimitives < frame->nprimitives; ++nprimitives) {
+      Polygon *const poly = &frame->polygons[nprimitives];
+      if (chance(state, params->moved)) {
+        poly->depth += random_range(state, -MaxRadius, MaxRadius);
+      }
+      if (!add_primitive(vertices, poly, nvertices, &prims[nprimitives])) {
+        return false;
+      }
+      nvertices += poly->nsides;
+    }
+  } else {
+    int const max_vertices = random_range(state, params->min_vertices,
+                                          params->max_vertices);
+    Polygon poly = {0};
+
+    while (max_vertices - nvertices >= params->min_sides) {
+      int nsides = random_range(state, params->min_sides, params->max_sides);
+      if (nsides > max_vertices - nvertices) {
+        nsides = max_vertices - nvertices;
+      }
+
+      if (nprimitives > 0 && poly.nsides <= max_vertices - nvertices &&
+          chance(state, params->duplicate)) {
+        /* Back face of the previous polygon */
+        poly.reversed = !poly.reversed;
+      } else if (nprimitives > 0 && poly.radius / 2 >= MinRadius &&
+                 chance(state, params->overlap)) {
+        /* Decal on the previous polygon */
+        poly.radius /= 2;
+        poly.phase = (double)next_random(state) / UINT32_MAX;
+        poly.nsides = nsides;
+      } else {
+        random_polygon(state, &poly, nsides);
+      }
+
+      if (!add_primitive(vertices, &poly, nvertices, &prims[nprimitives])) {
+        return false;
+      }
+
+      frame->polygons[nprimitives] = poly;
+      frame->colours[nprimitives++] =
+        (unsigned char)(next_random(state) % NColours);
+      nvertices += poly.nsides;
+    }
+    frame->nprimitives = nprimitives;
+  }
+
+  /* Objects are word-aligned, like the originals */
+  size_t const len = (size_t)nprimitives * (BytesPerPrimitive + 1);
+  return byte_buffer_append_le32(objects, (uint32_t)nvertices) &&
+         byte_buffer_append(objects, &*vertices->data, vertices->len) &&
+         byte_buffer_append_le32(objects, (uint32_t)nprimitives) &&
+         byte_buffer_append(objects, prims,
+                            (size_t)nprimitives * BytesPerPrimitive) &&
+         byte_buffer_append(objects, frame->colours, (size_t)nprimitives) &&
+         byte_buffer_fill(objects, 0, (4 - (len % 4)) % 4);
+}
+
+bool apoc_generate(const ApocGenParams * const params,
+                   ByteBuffer * const out, long int * const index_offset)
+{
+  assert(params != NULL);
+  assert(out != NULL);
+  assert(index_offset != NULL);
+
+  if (!check_params(params)) {
+    return false;
+  }
+
+  ByteBuffer objects, vertices;
+  byte_buffer_init(&objects);
+  byte_buffer_init(&vertices);
+
+  size_t const objects_start = MeshIndexOffset +
+                               ((size_t)params->index_size * sizeof(int32_t));
+  uint32_t state = params->seed ? params->seed : 1;
+  bool success = byte_buffer_fill(out, 0, MeshIndexOffset);
+  uint32_t address = 0;
+  Frame frame = {.nprimitives = 0};
+  int last_model = -1;
+
+  for (int object_count = 0;
+       success && object_count < params->nobjects;
+       ++object_count) {
+    size_t const file_pos = objects_start + objects.len;
+    if (file_pos > INT32_MAX - LoadAddress) {
+      fputs("Too much data to generate\n", stderr);
+      success = false;
+      break;
+    }
+    address = (uint32_t)(LoadAddress + file_pos);
+
+    /* Consecutive frames of the same model share most of their polygons */
+    int const model = get_obj_model(object_count);
+    bool const next_frame = model >= 0 && model == last_model;
+    last_model = model;
+
+    success = byte_buffer_append_le32(out, address) &&
+              add_object(params, &state, &frame, next_frame, &objects,
+                         &vertices);
+  }
+
+  for (int entry = params->nobjects;
+       success && entry < params->index_size;
+       ++entry) {
+    success = byte_buffer_append_le32(out, address);
+  }
+
+  if (success) {
+    success = byte_buffer_append(out, &*objects.data, objects.len);
+  }
+
+  byte_buffer_free(&vertices);
+  byte_buffer_free(&objects);
+
+  *index_offset = MeshIndexOffset;
+  return success;
+}
@@ -0,0 +1,40 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Synthetic object mesh generator
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef APOCGEN_H
+#define APOCGEN_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Local headers */
+#include "bytebuf.h"
+
+/* Describes a synthetic file to be generated. Each primitive is a regular
+   polygon in a plane parallel to two axes. Objects numbered as frames of
+   an animated model in the game (see get_obj_model) are animated. */
+typedef struct {
+  int nobjects;
+  int index_size; /* no. of index entries; any extras alias the last object */
+  int min_vertices, max_vertices; /* per object */
+  int min_sides, max_sides;       /* per primitive */
+  int overlap;   /* % of primitives inside the previous one in its plane */
+  int duplicate; /* % of primitives copying the previous one reversed */
+  int moved;     /* % of primitives moved in each frame of an animated
+                    model, which otherwise copies the previous frame */
+  uint32_t seed;
+} ApocGenParams;
+
+/* Gets the default parameters, which are similar to the real game data. */
+void apoc_gen_params_init(ApocGenParams *params);
+
+/* Generates a file laid out like the game's data, with an index of
+   polygon meshes at the usual position (returned in index_offset). */
+bool apoc_generate(const ApocGenParams *params, ByteBuffer *out,
+                   long int *index_offset);
+
+#endif /* APOCGEN_H */
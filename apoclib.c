@@ -0,0 +1,225 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Library interface for in-memory conversion
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Needed for fopencookie with the GNU C library */
+#define _GNU_SOURCE
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* Local header files */
+#include "apoclib.h"
+#include "parser.h"
+#include "bytebuf.h"
+#include "mapfile.h"
+#include "flags.h"
+#include "misc.h"
+
+#if defined(__GLIBC__)
+#define USE_FOPENCOOKIE
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__OpenBSD__)
+#define USE_FUNOPEN
+#endif
+
+enum {
+  CopyChunkSize = 64 * 1024,
+};
+
+typedef struct {
+  ApocWriteFn *write;
+  void *arg;
+} Writer;
+
+void apoc_options_init(ApocOptions * const opts)
+{
+  assert(opts != NULL);
+
+  *opts = (ApocOptions){
+    .first = -1,
+    .last = -1,
+    .name = NULL,
+    .index_offset = -1,
+    .nobjects = 0,
+    .mtl_file = "sf3k.mtl",
+    .njobs = 1,
+    .flags = 0,
+  };
+}
+
+/* Output is written by stdio (and by 3dObjLib), so it is passed to the
+   callback through a custom stream where the C library supports one, or
+   else through a temporary file. */
+#if defined(USE_FOPENCOOKIE)
+static ssize_t stream_write(void * const cookie, const char * const buf,
+                            size_t const size)
+{
+  const Writer *const writer = cookie;
+  assert(writer != NULL);
+  return writer->write(buf, size, writer->arg) ? (ssize_t)size : -1;
+}
+
+static _Optional FILE *open_stream(Writer * const writer)
+{
+  assert(writer != NULL);
+  cookie_io_functions_t const io = {
+    .read = NULL,
+    .write = stream_write,
+    .seek = NULL,
+    .close = NULL,
+  };
+  return fopencookie(writer, "w", io);
+}
+#elif defined(USE_FUNOPEN)
+static int stream_write(void * const cookie, const char * const buf,
+                        int const size)
+{
+  const Writer *const writer = cookie;
+  assert(writer != NULL);
+  assert(size >= 0);
+  return writer->write(buf, (size_t)size, writer->arg) ? size : -1;
+}
+
+static _Optional FILE *open_stream(Writer * const writer)
+{
+  assert(writer != NULL);
+  return funopen(writer, NULL, stream_write, NULL, NULL);
+}
+#else
+static _Optional FILE *open_stream(Writer * const writer)
+{
+  assert(writer != NULL);
+  NOT_USED(writer);
+  return tmpfile();
+}
+
+/* Passes everything written to a temporary file to the callback. */
+static bool copy_stream(FILE * const f, const Writer * const writer)
+{
+  assert(f != NULL);
+  assert(writer != NULL);
+
+  if (fflush(f) || fseek(f, 0, SEEK_SET)) {
+    return false;
+  }
+
+  char buf[CopyChunkSize];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    if (!writer->write(buf, n, writer->arg)) {
+      return false;
+    }
+  }
+  return !ferror(f);
+}
+#endif
+
+bool apoc_convert_to_callback(ApocContext * const ctx,
+                              const void * const data, size_t const size,
+                              const ApocOptions * const opts,
+                              ApocWriteFn * const write, void * const arg)
+{
+  assert(ctx != NULL);
+  assert(data != NULL || size == 0);
+  assert(opts != NULL);
+  assert(opts->mtl_file != NULL);
+  assert(opts->njobs >= 1);
+  assert(!(opts->flags & ~FLAGS_ALL));
+  assert(write != NULL);
+
+  unsigned int const flags = opts->flags;
+  int const first = opts->first < 0 ? 0 : opts->first;
+  long int const index_offset = opts->index_offset >= 0 ?
+    opts->index_offset : apoc_default_index_offset(flags);
+  int const nobjects = opts->nobjects > 0 ? opts->nobjects : 0;
+
+  if (opts->last >= 0 && first > opts->last) {
+    fputs("First object number must not exceed last object number\n",
+          stderr);
+    return false;
+  }
+
+  if (flags & FLAGS_LIST) {
+    /* No OBJ-format output */
+    return apoc_to_obj_ctx(ctx, data, size, NULL, first, opts->last,
+                           opts->name, index_offset, nobjects,
+                           opts->mtl_file, opts->njobs, flags);
+  }
+
+  Writer writer = {
+    .write = write,
+    .arg = arg,
+  };
+
+  _Optional FILE *const out = open_stream(&writer);
+  if (out == NULL) {
+    fprintf(stderr, "Failed to open output stream: %s\n", strerror(errno));
+    return false;
+  }
+
+  bool success = apoc_to_obj_ctx(ctx, data, size, &*out, first, opts->last,
+                                 opts->name, index_offset, nobjects,
+                                 opts->mtl_file, opts->njobs, flags);
+
+#if !defined(USE_FOPENCOOKIE) && !defined(USE_FUNOPEN)
+  if (success && !copy_stream(&*out, &writer)) {
+    fputs("Failed to pass output to the callback\n", stderr);
+    success = false;
+  }
+#endif
+
+  /* Buffered output is passed to the callback when the stream is closed */
+  if (fclose(&*out) && success) {
+    fputs("Failed to pass output to the callback\n", stderr);
+    success = false;
+  }
+
+  return success;
+}
+
+static bool append_output(const void * const data, size_t const size,
+                          void * const arg)
+{
+  ByteBuffer *const out = arg;
+  assert(out != NULL);
+  return byte_buffer_append(out, data, size);
+}
+
+bool apoc_convert_to_buffer(ApocContext * const ctx,
+                            const void * const data, size_t const size,
+                            const ApocOptions * const opts,
+                            ByteBuffer * const out)
+{
+  assert(out != NULL);
+  return apoc_convert_to_callback(ctx, data, size, opts, append_output, out);
+}
+
+bool apoc_read_all(ApocReadFn * const read, void * const arg,
+                   ByteBuffer * const in)
+{
+  assert(read != NULL);
+  assert(in != NULL);
+
+  return mapped_file_read_all(read, arg, &in->data, &in->len, &in->size);
+}
@@ -0,0 +1,59 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Library interface for in-memory conversion
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef APOCLIB_H
+#define APOCLIB_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Local headers */
+#include "parser.h"
+#include "bytebuf.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Consumes size bytes of output. Returns false to stop the conversion. */
+typedef bool ApocWriteFn(const void *data, size_t size, void *arg);
+
+/* Supplies up to size bytes of input. Returns the no. of bytes supplied
+   (0 at the end of the input) or a negative value on error. */
+typedef long int ApocReadFn(void *buffer, size_t size, void *arg);
+
+/* Everything the command-line switches control for one conversion. */
+typedef struct {
+  int first, last;              /* range of objects, or -1 for the default */
+  _Optional const char *name;   /* of one object to convert, or NULL */
+  long int index_offset;        /* of the object index, or -1 for default */
+  int nobjects;                 /* in the index, or 0 (the default) to
+                                   find them from the index */
+  const char *mtl_file;         /* referenced by OBJ output */
+  int njobs;                    /* no. of objects converted in parallel */
+  unsigned int flags;
+} ApocOptions;
+
+/* Sets the same defaults as the command-line program. */
+void apoc_options_init(ApocOptions *opts);
+
+/* Converts an Apocalypse data file held in memory, passing the output to
+   a callback in pieces as it is written. */
+bool apoc_convert_to_callback(ApocContext *ctx, const void *data,
+                              size_t size, const ApocOptions *opts,
+                              ApocWriteFn *write, void *arg);
+
+/* As apoc_convert_to_callback, but appends the output to a buffer. */
+bool apoc_convert_to_buffer(ApocContext *ctx, const void *data,
+                            size_t size, const ApocOptions *opts,
+                            ByteBuffer *out);
+
+/* Appends all of the input supplied by a callback to a buffer, so that it
+   can be converted. */
+bool apoc_read_all(ApocReadFn *read, void *arg, ByteBuffer *in);
+
+#endif /* APOCLIB_H */
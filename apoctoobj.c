@@ -32,34 +32,144 @@
 #include "ArgUtils.h"
 #include "StringBuff.h"
 
-/* StreamLib headers */
-#include "Reader.h"
-#include "ReaderRaw.h"
-
 /* Local headers */
 #include "flags.h"
 #include "parser.h"
+#include "mapfile.h"
+#include "cache.h"
+#include "jobs.h"
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
 #include "version.h"
 #include "misc.h"
 
 enum {
-  LoadAddress = 0x8f00,
-  FlatIndexAddress = 0x18b64,
-  MeshIndexAddress = 0x19b6c,
-  FlatIndexOffset = FlatIndexAddress - LoadAddress,
-  MeshIndexOffset = MeshIndexAddress - LoadAddress,
-  MaxNumObjects = 200,
+  OutputBufferSize = 256 * 1024,
 };
 
+typedef struct {
+  const char *in_file;
+  long int size; /* used to schedule big files first */
+  ApocStats stats;
+  bool success;
+} BatchFile;
+
+typedef struct {
+  BatchFile *files;
+  int first, last;
+  _Optional const char *name;
+  long int index_offset;
+  int nobjects; /* in the index, or 0 to find from the index */
+  const char *mtl_file;
+  int njobs; /* per file */
+  unsigned int flags;
+  bool time;
+  bool stats;
+  bool cache;
+  _Optional const char *obj_cache;
+} Batch;
+
+/* Lists objects from a sidecar cache of object summaries, which is
+   created or updated first if it doesn't match the input. Returns false if
+   the caller should list the objects in the usual way instead. */
+static bool list_cached(const char * const in_file,
+                        const MappedFile * const input,
+                        const int first, const int last,
+                        _Optional const char * const name,
+                        const long int index_offset, const int nobjects,
+                        const unsigned int flags, bool *const success)
+{
+  assert(in_file != NULL);
+  assert(input != NULL);
+  assert(success != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int const count = apoc_count_objects(input->data, input->size,
+                                      index_offset, nobjects, flags);
+  if (count < 0) {
+    /* The index is bad, and the error was reported */
+    *success = false;
+    return true;
+  }
+
+  bool listed = false;
+  StringBuffer cache_file;
+  stringbuffer_init(&cache_file);
+  _Optional ApocObjectInfo *const objects = malloc(sizeof(*objects) *
+                                                   (size_t)count);
+
+  if (objects == NULL ||
+      !stringbuffer_append(&cache_file, in_file, SIZE_MAX) ||
+      !stringbuffer_append_separated(&cache_file, EXT_SEPARATOR,
+                                     (flags & FLAGS_FLATS) ? "fidx" : "oidx")) {
+    fputs("Failed to allocate memory for object cache\n", stderr);
+  } else {
+    CacheKey key = {
+      .file_size = input->size,
+      .mtime = input->mtime,
+      .hash = 0,
+      .index_offset = index_offset,
+      .flats = (flags & FLAGS_FLATS) ? 1 : 0,
+      .count = count,
+    };
+    const char *const cache_name = stringbuffer_get_pointer(&cache_file);
+
+    /* Hashing the whole input takes about as long as listing it, so the
+       input is only hashed if its modification time isn't a match */
+    listed = key.mtime >= 0 && cache_load(cache_name, &key, false,
+                                          &*objects);
+    if (!listed) {
+      key.hash = cache_hash(input->data, input->size);
+      listed = cache_load(cache_name, &key, true, &*objects);
+
+      /* Record the new modification time of unchanged input */
+      if (listed && key.mtime >= 0) {
+        (void)cache_save(cache_name, &key, &*objects);
+      }
+    }
+    if (!listed) {
+      ApocContext ctx;
+      apoc_context_init(&ctx);
+      if (apoc_scan_ctx(&ctx, input->data, input->size, index_offset,
+                        count, &*objects, flags)) {
+        /* Failure to save the cache isn't fatal */
+        (void)cache_save(cache_name, &key, &*objects);
+        listed = true;
+      } else if (first <= 0 && (last < 0 || last >= count - 1) &&
+                 name == NULL) {
+        /* The selected objects are bad, and the error was reported */
+        *success = false;
+        listed = true;
+      }
+      apoc_context_free(&ctx);
+    }
+
+    if (listed && *success) {
+      *success = apoc_list(&*objects, count, first, last, name, flags);
+    }
+  }
+
+  free(objects);
+  stringbuffer_destroy(&cache_file);
+  return listed;
+}
+
 static bool process_file(_Optional const char * const in_file,
                          _Optional const char * const output_file,
                          const int first, const int last,
                          _Optional const char * const name,
                          const long int index_offset,
+                         const int nobjects,
                          const char * const mtl_file,
-                         const unsigned int flags, const bool time)
+                         const int njobs,
+                         const unsigned int flags, const bool time,
+                         _Optional ApocStats * const stats,
+                         const bool cache,
+                         _Optional const char * const obj_cache)
 {
   _Optional FILE *out = NULL, *in = NULL;
+  _Optional char *out_buffer = NULL;
   bool success = true;
 
   assert(!(flags & ~FLAGS_ALL));
@@ -88,11 +198,20 @@ static bool process_file(_Optional const char * const in_file,
       if (flags & FLAGS_VERBOSE)
         printf("Opening output file '%s'\n", output_file);
 
-      out = fopen(&*output_file, "w");
+      out = fopen(&*output_file, (flags & FLAGS_BINARY) ? "wb" : "w");
       if (out == NULL) {
         fprintf(stderr, "Failed to open output file '%s': %s\n",
                         output_file, strerror(errno));
         success = false;
+      } else {
+        /* Output is written in many small pieces, so give the stream a
+           much bigger buffer than the default. Failure isn't fatal. */
+        out_buffer = malloc(OutputBufferSize);
+        if (out_buffer != NULL &&
+            setvbuf(&*out, &*out_buffer, _IOFBF, OutputBufferSize)) {
+          free(out_buffer);
+          out_buffer = NULL;
+        }
       }
     } else {
       /* Default output is to standard output stream */
@@ -102,16 +221,34 @@ static bool process_file(_Optional const char * const in_file,
 
   if (success && in) {
     const clock_t start_time = time ? clock() : 0;
+    double const start = apoc_stats_start(stats);
 
-    Reader reader;
-    reader_raw_init(&reader, &*in);
-
+    MappedFile input;
+    success = mapped_file_init(&input, &*in);
     if (success) {
-      success = apoc_to_obj(&reader, out, first, last, name,
-                            index_offset, mtl_file, flags);
+      /* Debug output can't be reproduced from the cache */
+      if (!cache || in_file == NULL || out != NULL ||
+          (flags & FLAGS_VERBOSE) ||
+          !list_cached(&*in_file, &input, first, last, name, index_offset,
+                       nobjects, flags, &success)) {
+        ApocContext ctx;
+        apoc_context_init(&ctx);
+        ctx.fragment_dir = obj_cache;
+        ctx.stats = stats;
+        success = apoc_to_obj_ctx(&ctx, input.data, input.size, out, first,
+                                  last, name, index_offset, nobjects,
+                                  mtl_file, njobs, flags);
+        apoc_context_free(&ctx);
+      }
+      mapped_file_destroy(&input);
     }
 
-    reader_destroy(&reader);
+    if (stats != NULL) {
+      stats->total += timer_now() - start;
+      ++stats->nfiles;
+      apoc_stats_span(stats, "file", in_file != NULL ? &*in_file : "stdin",
+                      -1, start);
+    }
 
     if (success && time)
     {
@@ -137,6 +274,9 @@ static bool process_file(_Optional const char * const in_file,
     }
   }
 
+  /* The stream buffer must outlive the stream */
+  free(out_buffer);
+
   /* Delete malformed output unless debugging is enabled or
      it may actually be the index (still intact) */
   if (!success && !(flags & FLAGS_VERBOSE) && out != NULL && out != stdout &&
@@ -147,6 +287,217 @@ static bool process_file(_Optional const char * const in_file,
   return success;
 }
 
+static bool process_batch_file(const char * const in_file,
+                               const int first, const int last,
+                               _Optional const char * const name,
+                               const long int index_offset,
+                               const int nobjects,
+                               const char * const mtl_file,
+                               const int njobs,
+                               const unsigned int flags, const bool time,
+                               _Optional ApocStats * const stats,
+                               const bool cache,
+                               _Optional const char * const obj_cache)
+{
+  assert(in_file != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  /* Invent an output file name */
+  bool success = false;
+  StringBuffer default_output;
+  stringbuffer_init(&default_output);
+  if (!stringbuffer_append(&default_output, in_file, SIZE_MAX) ||
+      !stringbuffer_append_separated(&default_output, EXT_SEPARATOR,
+                                     (flags & FLAGS_GLB) ? "glb" :
+                                     (flags & FLAGS_PLY) ? "ply" :
+                                     (flags & FLAGS_ARCHIVE) ? "mesh" :
+                                     "obj")) {
+    fprintf(stderr, "Failed to allocate memory for output file path\n");
+  } else {
+    success = process_file(in_file,
+                           stringbuffer_get_pointer(&default_output),
+                           first, last, name, index_offset, nobjects,
+                           mtl_file, njobs, flags, time, stats, cache,
+                           obj_cache);
+  }
+  stringbuffer_destroy(&default_output);
+  return success;
+}
+
+static bool batch_job(void * const arg, int const job)
+{
+  Batch *const batch = arg;
+  assert(batch != NULL);
+  assert(job >= 0);
+
+  BatchFile *const file = &batch->files[job];
+  file->success = process_batch_file(file->in_file, batch->first,
+                                     batch->last, batch->name,
+                                     batch->index_offset, batch->nobjects,
+                                     batch->mtl_file,
+                                     batch->njobs, batch->flags, batch->time,
+                                     batch->stats ? &file->stats : NULL,
+                                     batch->cache, batch->obj_cache);
+
+  /* Failure to convert one file doesn't stop the others */
+  return true;
+}
+
+static long int get_file_size(const char * const file_name)
+{
+  assert(file_name != NULL);
+
+  long int size = -1;
+  _Optional FILE *const f = fopen(file_name, "rb");
+  if (f != NULL) {
+    if (!fseek(&*f, 0, SEEK_END)) {
+      size = ftell(&*f);
+    }
+    fclose(&*f);
+  }
+  return size;
+}
+
+static int compare_size(const void * const a, const void * const b)
+{
+  const BatchFile *const fa = a, *const fb = b;
+  /* Biggest first */
+  return (fa->size < fb->size) - (fa->size > fb->size);
+}
+
+static bool process_batch_jobs(const int nfiles, const char * const files[],
+                               const int njobs,
+                               const int first, const int last,
+                               _Optional const char * const name,
+                               const long int index_offset,
+                               const int nobjects,
+                               const char * const mtl_file,
+                               const unsigned int flags, const bool time,
+                               _Optional ApocStats * const stats,
+                               const bool cache,
+                               _Optional const char * const obj_cache)
+{
+  assert(nfiles > 0);
+  assert(files != NULL);
+  assert(njobs > 1);
+  assert(!(flags & ~FLAGS_ALL));
+
+  _Optional BatchFile *const batch_files = malloc(sizeof(*batch_files) *
+                                                  (size_t)nfiles);
+  if (batch_files == NULL) {
+    fputs("Failed to allocate memory for batch\n", stderr);
+    return false;
+  }
+
+  for (int f = 0; f < nfiles; ++f) {
+    batch_files[f].in_file = files[f];
+    batch_files[f].size = get_file_size(files[f]);
+    apoc_stats_init(&batch_files[f].stats);
+    if (stats != NULL) {
+      batch_files[f].stats.trace = stats->trace;
+    }
+    batch_files[f].success = false;
+  }
+
+  /* Start converting the biggest files first, so that one big file doesn't
+     leave the other workers idle at the end */
+  qsort(&*batch_files, (size_t)nfiles, sizeof(*batch_files), compare_size);
+
+  Batch batch = {
+    .files = &*batch_files,
+    .first = first,
+    .last = last,
+    .name = name,
+    .index_offset = index_offset,
+    .nobjects = nobjects,
+    .mtl_file = mtl_file,
+    /* Spare threads can convert objects within each file */
+    .njobs = njobs > nfiles ? njobs / nfiles : 1,
+    .flags = flags,
+    .time = time,
+    .stats = stats != NULL,
+    .cache = cache,
+    .obj_cache = obj_cache,
+  };
+
+  if (!jobs_run(njobs, nfiles, batch_job, &batch)) {
+    fputs("Warning: failed to start all worker threads\n", stderr);
+  }
+
+  for (int f = 0; stats != NULL && f < nfiles; ++f) {
+    apoc_stats_add(&*stats, &batch_files[f].stats);
+  }
+
+  /* Report the result for each file in the order that they were given */
+  int nfailed = 0;
+  for (int f = 0; f < nfiles; ++f) {
+    for (int j = 0; j < nfiles; ++j) {
+      if (batch_files[j].in_file == files[f]) {
+        if (!batch_files[j].success) {
+          fprintf(stderr, "Failed to convert '%s'\n", files[f]);
+          ++nfailed;
+        }
+        break;
+      }
+    }
+  }
+
+  if (nfailed > 0) {
+    fprintf(stderr, "%d of %d files failed to convert\n", nfailed, nfiles);
+  }
+
+  free(batch_files);
+  return nfailed == 0;
+}
+
+static bool write_stats(const ApocStats * const stats,
+                        const char * const stats_file)
+{
+  assert(stats != NULL);
+  assert(stats_file != NULL);
+
+  _Optional FILE *const f = fopen(stats_file, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open statistics file '%s': %s\n",
+            stats_file, strerror(errno));
+    return false;
+  }
+
+  bool success = apoc_stats_write_json(stats, &*f);
+  if (fclose(&*f)) {
+    success = false;
+  }
+  if (!success) {
+    fprintf(stderr, "Failed to write statistics file '%s': %s\n",
+            stats_file, strerror(errno));
+  }
+  return success;
+}
+
+static bool write_trace(const ApocTrace * const trace,
+                        const char * const trace_file)
+{
+  assert(trace != NULL);
+  assert(trace_file != NULL);
+
+  _Optional FILE *const f = fopen(trace_file, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open trace file '%s': %s\n",
+            trace_file, strerror(errno));
+    return false;
+  }
+
+  bool success = apoc_trace_write(trace, &*f);
+  if (fclose(&*f)) {
+    success = false;
+  }
+  if (!success) {
+    fprintf(stderr, "Failed to write trace file '%s': %s\n",
+            trace_file, strerror(errno));
+  }
+  return success;
+}
+
 static int syntax_msg(FILE * const f, const char * const path)
 {
   assert(f != NULL);
@@ -159,7 +510,7 @@ static int syntax_msg(FILE * const f, const char * const path)
           "If no input file is specified, it reads from stdin.\n"
           "If no output file is specified, it writes to stdout.\n"
           "In batch processing mode, output file names are generated by appending\n"
-          "extension 'obj' to the input file names.\n"
+          "extension 'obj' (or 'glb', 'ply' or 'mesh') to the input file names.\n"
           "If a material library file is specified then a reference to it will be\n"
           "inserted in the output. This file is not created, read or written.\n",
           leaf, leaf);
@@ -167,18 +518,29 @@ static int syntax_msg(FILE * const f, const char * const path)
   fputs("Switches (names may be abbreviated):\n"
         "  -help               Display this text\n"
         "  -batch              Process a batch of files (see above)\n"
+        "  -cache              Keep an index of objects to speed up listing\n"
+        "  -count N            No. of objects in the address table (default is\n"
+        "                      to find it)\n"
         "  -flats              Convert or list flats instead of polygon meshes\n"
         "  -list               List objects instead of converting them\n"
         "  -index N            Object number to convert or list (default is all)\n"
+        "  -jobs N             Convert up to N files or objects in parallel\n"
         "  -first N            First object number to convert or list\n"
         "  -last N             Last object number to convert or list\n"
         "  -name <name>        Object name to convert or list (default is all)\n"
+        "  -objcache <dir>     Reuse output for unchanged objects from a directory\n"
         "  -offset N           Byte offset to object address table in input\n"
         "  -outfile <name>     Write output to the named file instead of stdout\n"
+        "  -stats              Show the time taken by each stage (on stderr)\n"
+        "  -statsfile <name>   Write the time taken by each stage as JSON\n"
         "  -time               Show the total time for each file processed\n"
+        "  -trace <name>       Write a timeline of the conversion as JSON\n"
         "  -verbose or -debug  Emit debug information (and keep bad output)\n", f);
 
   fputs("Switches to customize the output:\n"
+        "  -archive            Write a mesh archive instead of Wavefront OBJ\n"
+        "  -glb                Write binary glTF instead of Wavefront OBJ\n"
+        "  -ply                Write binary PLY instead of Wavefront OBJ\n"
         "  -mtllib name        Specify a material library file (default sf3k.mtl)\n"
         "  -human              Output readable material names\n"
         "  -false              Assign false colours for visualization\n"
@@ -188,7 +550,8 @@ static int syntax_msg(FILE * const f, const char * const path)
         "  -clip               Clip overlapping coplanar polygons\n"
         "  -flip               Flip back-facing flats\n"
         "  -fans               Split complex polygons into triangle fans\n"
-        "  -strips             Split complex polygons into triangle strips\n", f);
+        "  -strips             Split complex polygons into triangle strips\n"
+        "  -share              Share identical vertices between animation frames\n", f);
 
   return EXIT_FAILURE;
 }
@@ -220,12 +583,15 @@ int main(int argc, const char *argv[])
 #endif
 {
   int n, first = -1, last = -1;
-  long int index_offset = -1;
+  long int index_offset = -1, nobjects = 0;
   unsigned int flags = 0;
   _Optional const char *name = NULL;
-  bool time = false, batch = false;
+  bool time = false, batch = false, cache = false, want_stats = false;
+  long int njobs = 1;
   int rtn = EXIT_SUCCESS;
-  _Optional const char *in_file = NULL, *output_file = NULL;
+  _Optional const char *in_file = NULL, *output_file = NULL,
+                       *obj_cache = NULL, *stats_file = NULL,
+                       *trace_file = NULL;
   const char *mtl_file = "sf3k.mtl";
 
   assert(argc > 0);
@@ -237,12 +603,23 @@ int main(int argc, const char *argv[])
   for (n = 1; n < argc && argv[n][0] == '-'; n++) {
     const char *opt = argv[n] + 1;
 
-    if (is_switch(opt, "batch", 1)) {
+    if (is_switch(opt, "archive", 1)) {
+      /* Enable mesh archive output */
+      flags |= FLAGS_ARCHIVE;
+    } else if (is_switch(opt, "batch", 1)) {
       /* Enable batch processing mode */
       batch = true;
+    } else if (is_switch(opt, "cache", 2)) {
+      /* Enable the sidecar cache of object summaries */
+      cache = true;
     } else if (is_switch(opt, "clip", 1)) {
       /* Enable clipping of coplanar polygons */
       flags |= FLAGS_CLIP_POLYGONS;
+    } else if (is_switch(opt, "count", 2)) {
+      /* Number of objects in the index was specified */
+      if (!get_long_arg("count", &nobjects, 0, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
     } else if (is_switch(opt, "debug", 2)) {
       /* Enable debugging output */
       flags |= FLAGS_VERBOSE;
@@ -258,7 +635,7 @@ int main(int argc, const char *argv[])
     } else if (is_switch(opt, "first", 2)) {
       /* First object number to convert was specified */
       long int objnum;
-      if (!get_long_arg("first", &objnum, 0, MaxNumObjects - 1, argc, argv, ++n)) {
+      if (!get_long_arg("first", &objnum, 0, INT_MAX, argc, argv, ++n)) {
         return syntax_msg(stderr, argv[0]);
       }
       first = (int)objnum;
@@ -268,6 +645,9 @@ int main(int argc, const char *argv[])
     } else if (is_switch(opt, "flip", 3)) {
       /* Flip backfacing ground polygons */
       flags |= FLAGS_FLIP_BACKFACING;
+    } else if (is_switch(opt, "glb", 1)) {
+      /* Enable binary glTF output */
+      flags |= FLAGS_GLB;
     } else if (is_switch(opt, "help", 2)) {
       /* Output usage information */
       (void)syntax_msg(stdout, argv[0]);
@@ -278,14 +658,19 @@ int main(int argc, const char *argv[])
     } else if (is_switch(opt, "index", 1)) {
       /* Object number to convert was specified */
       long int objnum;
-      if (!get_long_arg("index", &objnum, 0, MaxNumObjects - 1, argc, argv, ++n)) {
+      if (!get_long_arg("index", &objnum, 0, INT_MAX, argc, argv, ++n)) {
         return syntax_msg(stderr, argv[0]);
       }
       first = last = (int)objnum;
+    } else if (is_switch(opt, "jobs", 1)) {
+      /* Number of files to convert in parallel was specified */
+      if (!get_long_arg("jobs", &njobs, 1, JobsMaxThreads, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
     } else if (is_switch(opt, "last", 2)) {
       /* Last object number to convert was specified */
       long int objnum;
-      if (!get_long_arg("last", &objnum, 0, MaxNumObjects - 1, argc, argv, ++n)) {
+      if (!get_long_arg("last", &objnum, 0, INT_MAX, argc, argv, ++n)) {
         return syntax_msg(stderr, argv[0]);
       }
       last = (int)objnum;
@@ -310,6 +695,13 @@ int main(int argc, const char *argv[])
     } else if (is_switch(opt, "negative", 2)) {
       /* Enable negative vertex indices */
       flags |= FLAGS_NEGATIVE_INDICES;
+    } else if (is_switch(opt, "objcache", 2)) {
+      /* Directory of reusable output for objects was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing object cache directory name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      obj_cache = argv[n];
     } else if (is_switch(opt, "outfile", 2)) {
       /* Output file path was specified */
       if (++n >= argc || argv[n][0] == '-') {
@@ -322,12 +714,36 @@ int main(int argc, const char *argv[])
       if (!get_long_arg("offset", &index_offset, 0, LONG_MAX, argc, argv, ++n)) {
         return syntax_msg(stderr, argv[0]);
       }
+    } else if (is_switch(opt, "ply", 1)) {
+      /* Enable binary PLY output */
+      flags |= FLAGS_PLY;
+    } else if (is_switch(opt, "share", 2)) {
+      /* Enable sharing of vertices between animation frames */
+      flags |= FLAGS_SHARE_VERTICES;
+    } else if (is_switch(opt, "statsfile", 6)) {
+      /* File for statistics in JSON format was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing statistics file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      stats_file = argv[n];
+      want_stats = true;
+    } else if (is_switch(opt, "stats", 3)) {
+      /* Enable per-stage statistics */
+      want_stats = true;
     } else if (is_switch(opt, "strips", 1)) {
       /* Enable decomposition of complex polygons into triangle strips */
       flags |= FLAGS_TRIANGLE_STRIPS;
     } else if (is_switch(opt, "time", 1)) {
       /* Enable timing */
       time = true;
+    } else if (is_switch(opt, "trace", 2)) {
+      /* File for a trace of the conversion was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing trace file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      trace_file = argv[n];
     } else if (is_switch(opt, "unused", 1)) {
       /* Enable output of unused vertices */
       flags |= FLAGS_UNUSED;
@@ -341,7 +757,7 @@ int main(int argc, const char *argv[])
   }
 
   if (index_offset < 0) {
-    index_offset = (flags & FLAGS_FLATS) ? FlatIndexOffset : MeshIndexOffset;
+    index_offset = apoc_default_index_offset(flags);
   }
 
   if ((first > last) && (last >= 0)) {
@@ -357,6 +773,12 @@ int main(int argc, const char *argv[])
     return EXIT_FAILURE;
   }
 
+  /* At most one bit may be set */
+  if ((flags & FLAGS_BINARY) & ((flags & FLAGS_BINARY) - 1)) {
+    fputs("Cannot write more than one binary output format\n", stderr);
+    return EXIT_FAILURE;
+  }
+
   if (batch) {
     if (output_file != NULL) {
       fputs("Cannot specify an output file in batch processing mode\n",
@@ -367,7 +789,14 @@ int main(int argc, const char *argv[])
       fputs("Must specify file(s) in batch processing mode\n", stderr);
       return syntax_msg(stderr, argv[0]);
     }
+    /* Ensure that output from different files isn't interleaved */
+    if (njobs > 1 && (flags & (FLAGS_LIST | FLAGS_VERBOSE))) {
+      fputs("Cannot list objects or emit debug information "
+            "using parallel jobs\n", stderr);
+      return EXIT_FAILURE;
+    }
   } else {
+
     /* If an input file was specified, it should follow the switches */
     if (n < argc) {
       in_file = argv[n++];
@@ -388,6 +817,13 @@ int main(int argc, const char *argv[])
       return EXIT_FAILURE;
     }
 
+    /* Standard output is a text stream */
+    if ((output_file == NULL) && !(flags & FLAGS_LIST) &&
+        (flags & FLAGS_BINARY)) {
+      fputs("Must specify an output file for binary output\n", stderr);
+      return EXIT_FAILURE;
+    }
+
     /* Ensure that OBJ output isn't mixed up with other text on stdout */
     if ((output_file == NULL) && !(flags & FLAGS_LIST) &&
         (time || (flags & FLAGS_VERBOSE))) {
@@ -406,31 +842,57 @@ int main(int argc, const char *argv[])
            "Copyright (C) 2020, Christopher Bazley\n");
   }
 
-  if (batch) {
+  /* A trace is made from the same measurements as statistics */
+  ApocStats stats;
+  apoc_stats_init(&stats);
+  _Optional ApocStats *const pstats = (want_stats || trace_file != NULL) ?
+                                      &stats : NULL;
+  if (trace_file != NULL) {
+    stats.trace = apoc_trace_create();
+    if (stats.trace == NULL) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (batch && njobs > 1) {
+    /* Convert all of the files, even if some fail, and report the result
+       for each one */
+    if (!process_batch_jobs(argc - n, argv + n, (int)njobs, first, last,
+                            name, index_offset, (int)nobjects, mtl_file,
+                            flags, time, pstats, cache, obj_cache)) {
+      rtn = EXIT_FAILURE;
+    }
+  } else if (batch) {
     /* In batch processing mode, the remaining arguments are treated as a
        list of file names (output to default file names) */
     for (; n < argc && rtn == EXIT_SUCCESS; n++) {
-      /* Invent an output file name */
       assert(argv[n] != NULL);
-      StringBuffer default_output;
-      stringbuffer_init(&default_output);
-      if (!stringbuffer_append(&default_output, argv[n], SIZE_MAX) ||
-          !stringbuffer_append_separated(&default_output, EXT_SEPARATOR,
-                                         "obj")) {
-        fprintf(stderr, "Failed to allocate memory for output file path\n");
-        rtn = EXIT_FAILURE;
-      } else if (!process_file(argv[n],
-                               stringbuffer_get_pointer(&default_output),
-                               first, last, name, index_offset,
-                               mtl_file, flags, time)) {
+      if (!process_batch_file(argv[n], first, last, name, index_offset,
+                              (int)nobjects, mtl_file, 1, flags, time,
+                              pstats, cache, obj_cache)) {
         rtn = EXIT_FAILURE;
       }
-      stringbuffer_destroy(&default_output);
     }
   } else if (!process_file(in_file, output_file, first, last, name,
-                    index_offset, mtl_file, flags, time)) {
+                    index_offset, (int)nobjects, mtl_file, (int)njobs, flags,
+                    time, pstats, cache, obj_cache)) {
     rtn = EXIT_FAILURE;
   }
 
+  if (stats_file != NULL) {
+    if (!write_stats(&stats, &*stats_file)) {
+      rtn = EXIT_FAILURE;
+    }
+  } else if (want_stats) {
+    apoc_stats_print(&stats, stderr);
+  }
+
+  if (trace_file != NULL) {
+    if (!write_trace(&*stats.trace, &*trace_file)) {
+      rtn = EXIT_FAILURE;
+    }
+    apoc_trace_destroy(stats.trace);
+  }
+
   return rtn;
 }
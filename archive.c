@@ -0,0 +1,329 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Mesh archive output
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local header files */
+#include "archive.h"
+#include "bytebuf.h"
+#include "meshout.h"
+#include "decode.h"
+#include "flags.h"
+#include "misc.h"
+
+/* All values are stored little-endian, and every array starts on a
+   multiple of BlockAlignment bytes from the start of the file. */
+enum {
+  ArchiveVersion = 1,
+  HeaderSize = 32,
+  EntrySize = 48,
+  BlockAlignment = 16,
+  MaxShortIndex = UINT16_MAX,
+};
+
+static const unsigned char magic[4] = {'A', 'p', 'M', 'A'};
+
+void archive_init(ArchiveWriter * const archive)
+{
+  assert(archive != NULL);
+
+  archive->entries = NULL;
+  archive->entries_size = 0;
+  byte_buffer_init(&archive->data);
+  byte_buffer_init(&archive->names);
+  vertex_map_init(&archive->vmap);
+  byte_buffer_init(&archive->x);
+  byte_buffer_init(&archive->y);
+  byte_buffer_init(&archive->z);
+  byte_buffer_init(&archive->indices);
+  byte_buffer_init(&archive->colours);
+  archive_reset(archive);
+}
+
+void archive_free(ArchiveWriter * const archive)
+{
+  assert(archive != NULL);
+
+  free(archive->entries);
+  byte_buffer_free(&archive->data);
+  byte_buffer_free(&archive->names);
+  vertex_map_free(&archive->vmap);
+  byte_buffer_free(&archive->x);
+  byte_buffer_free(&archive->y);
+  byte_buffer_free(&archive->z);
+  byte_buffer_free(&archive->indices);
+  byte_buffer_free(&archive->colours);
+  archive_init(archive);
+}
+
+void archive_reset(ArchiveWriter * const archive)
+{
+  assert(archive != NULL);
+
+  archive->nentries = 0;
+  byte_buffer_reset(&archive->data);
+  byte_buffer_reset(&archive->names);
+}
+
+/* Outputs a vertex unless it (or a duplicate) has been output already. */
+static bool add_vertex(ArchiveWriter * const archive,
+                       const VertexArray * const varray, int const v)
+{
+  assert(archive != NULL);
+  assert(varray != NULL);
+
+  bool added;
+  if (vertex_map_add(&archive->vmap, varray, v, &added) < 0) {
+    return false;
+  }
+  if (!added) {
+    return true;
+  }
+
+  _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, v);
+  assert(coords != NULL);
+
+  return byte_buffer_append_float(&archive->x, (float)(*coords)[0]) &&
+         byte_buffer_append_float(&archive->y, (float)(*coords)[1]) &&
+         byte_buffer_append_float(&archive->z, (float)(*coords)[2]);
+}
+
+/* Appends an array to the data block, returning its offset in *offset. */
+static bool add_block(ArchiveWriter * const archive,
+                      const ByteBuffer * const block, uint32_t * const offset)
+{
+  assert(archive != NULL);
+  assert(block != NULL);
+  assert(offset != NULL);
+  assert(archive->data.len % BlockAlignment == 0);
+
+  if (archive->data.len > UINT32_MAX - block->len - BlockAlignment) {
+    fputs("Output is too big for a mesh archive\n", stderr);
+    return false;
+  }
+
+  *offset = (uint32_t)archive->data.len;
+  size_t const misalign = block->len % BlockAlignment;
+  return byte_buffer_append(&archive->data, &*block->data, block->len) &&
+         byte_buffer_fill(&archive->data, 0,
+                          misalign ? BlockAlignment - misalign : 0);
+}
+
+bool archive_add_object(ArchiveWriter * const archive,
+                        const char * const name, int const object_count,
+                        const VertexArray * const varray,
+                        const Group * const group,
+                        _Optional OutputPrimitivesGetColourFn * const get_colour,
+                        void * const arg, const unsigned int flags)
+{
+  assert(archive != NULL);
+  assert(name != NULL);
+  assert(object_count >= 0);
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (archive->nentries == archive->entries_size) {
+    size_t const new_size = archive->entries_size ?
+                            archive->entries_size * 2 : 64;
+    _Optional ArchiveEntry *const new_entries =
+      realloc(archive->entries, new_size * sizeof(*new_entries));
+    if (new_entries == NULL) {
+      fputs("Failed to allocate memory for mesh archive\n", stderr);
+      return false;
+    }
+    archive->entries = new_entries;
+    archive->entries_size = new_size;
+  }
+
+  if (!vertex_map_start(&archive->vmap, varray, flags)) {
+    return false;
+  }
+
+  byte_buffer_reset(&archive->x);
+  byte_buffer_reset(&archive->y);
+  byte_buffer_reset(&archive->z);
+  byte_buffer_reset(&archive->indices);
+  byte_buffer_reset(&archive->colours);
+
+  if (flags & FLAGS_UNUSED) {
+    int const nvertices = vertex_array_get_num_vertices(varray);
+    for (int v = 0; v < nvertices; ++v) {
+      if (!add_vertex(archive, varray, v)) {
+        return false;
+      }
+    }
+  }
+
+  /* The no. of vertices decides the index size, so indices are stored as
+     32-bit values until all of the vertices are known. */
+  int const nprimitives = group_get_num_primitives(group);
+  uint32_t ntriangles = 0;
+  for (int p = 0; p < nprimitives; ++p) {
+    _Optional const Primitive *const pp = group_get_primitive(group, p);
+    if (pp == NULL) {
+      continue;
+    }
+
+    int const nsides = primitive_get_num_sides(&*pp);
+    if (nsides < 3) {
+      continue;
+    }
+
+    int const colour = get_colour ? get_colour(&*pp, arg) :
+                                    primitive_get_colour(&*pp);
+    assert(colour >= 0);
+    assert(colour <= UINT8_MAX);
+
+    for (int s = 0; s < nsides; ++s) {
+      if (!add_vertex(archive, varray, primitive_get_side(&*pp, s))) {
+        return false;
+      }
+    }
+
+    for (int t = 0; t < nsides - 2; ++t) {
+      int sides[3];
+      get_triangle(nsides, t, flags, &sides);
+      for (size_t k = 0; k < ARRAY_SIZE(sides); ++k) {
+        int const n = vertex_map_get(&archive->vmap,
+                                     primitive_get_side(&*pp, sides[k]));
+        if (!byte_buffer_append_le32(&archive->indices, (uint32_t)n)) {
+          return false;
+        }
+      }
+      unsigned char const c = (unsigned char)colour;
+      if (!byte_buffer_append(&archive->colours, &c, sizeof(c))) {
+        return false;
+      }
+      ++ntriangles;
+    }
+  }
+
+  ArchiveEntry *const entry = &archive->entries[archive->nentries];
+  *entry = (ArchiveEntry){
+    .name = (uint32_t)archive->names.len,
+    .object = (uint32_t)object_count,
+    .nvertices = (uint32_t)archive->vmap.count,
+    .ntriangles = ntriangles,
+    .index_size = archive->vmap.count <= MaxShortIndex + 1 ? 2 : 4,
+  };
+
+  if (!byte_buffer_append(&archive->names, name, strlen(name) + 1)) {
+    return false;
+  }
+
+  if (entry->index_size == 2) {
+    /* Narrow the indices in place */
+    unsigned char *const indices = &*archive->indices.data;
+    size_t const count = archive->indices.len / 4;
+    for (size_t i = 0; i < count; ++i) {
+      indices[i * 2] = indices[i * 4];
+      indices[i * 2 + 1] = indices[i * 4 + 1];
+    }
+    archive->indices.len = count * 2;
+  }
+
+  if (!add_block(archive, &archive->x, &entry->x) ||
+      !add_block(archive, &archive->y, &entry->y) ||
+      !add_block(archive, &archive->z, &entry->z) ||
+      !add_block(archive, &archive->indices, &entry->indices) ||
+      !add_block(archive, &archive->colours, &entry->colours)) {
+    return false;
+  }
+
+  ++archive->nentries;
+  return true;
+}
+
+bool archive_write(const ArchiveWriter * const archive, FILE * const out)
+{
+  assert(archive != NULL);
+  assert(out != NULL);
+
+  size_t const data_start = HeaderSize + (archive->nentries * EntrySize);
+  size_t const names_start = data_start + archive->data.len;
+  size_t const total = names_start + archive->names.len;
+  if (archive->nentries > UINT32_MAX / EntrySize || total > UINT32_MAX) {
+    fputs("Output is too big for a mesh archive\n", stderr);
+    return false;
+  }
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, magic, sizeof(magic));
+  encode_uint32(header + 4, ArchiveVersion);
+  encode_uint32(header + 8, (uint32_t)archive->nentries);
+  encode_uint32(header + 12, EntrySize);
+  encode_uint32(header + 16, HeaderSize);
+  encode_uint32(header + 20, (uint32_t)names_start);
+  encode_uint32(header + 24, (uint32_t)total);
+
+  if (fwrite(header, sizeof(header), 1, out) != 1) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  for (size_t i = 0; i < archive->nentries; ++i) {
+    const ArchiveEntry *const entry = &archive->entries[i];
+    uint32_t const base = (uint32_t)data_start;
+    unsigned char dir[EntrySize] = {0};
+
+    encode_uint32(dir, (uint32_t)names_start + entry->name);
+    encode_uint32(dir + 4, entry->object);
+    encode_uint32(dir + 8, entry->nvertices);
+    encode_uint32(dir + 12, entry->ntriangles);
+    encode_uint32(dir + 16, base + entry->x);
+    encode_uint32(dir + 20, base + entry->y);
+    encode_uint32(dir + 24, base + entry->z);
+    encode_uint32(dir + 28, base + entry->indices);
+    encode_uint32(dir + 32, base + entry->colours);
+    encode_uint32(dir + 36, entry->index_size);
+
+    if (fwrite(dir, sizeof(dir), 1, out) != 1) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      return false;
+    }
+  }
+
+  if ((archive->data.len > 0 &&
+       fwrite(&*archive->data.data, archive->data.len, 1, out) != 1) ||
+      (archive->names.len > 0 &&
+       fwrite(&*archive->names.data, archive->names.len, 1, out) != 1)) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  return true;
+}
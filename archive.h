@@ -0,0 +1,76 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Mesh archive output
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* 3dObjLib headers */
+#include "Vertex.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local headers */
+#include "bytebuf.h"
+#include "meshout.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Where the data for an object is, relative to the start of the data
+   and name blocks. */
+typedef struct {
+  uint32_t name;
+  uint32_t object;
+  uint32_t nvertices;
+  uint32_t ntriangles;
+  uint32_t x, y, z;
+  uint32_t indices;
+  uint32_t colours;
+  uint32_t index_size;
+} ArchiveEntry;
+
+/* Accumulates objects for a mesh archive, which can't be written until
+   all of them are known because it starts with a directory. The archive
+   is designed to be mapped into memory and used in place. */
+typedef struct {
+  _Optional ArchiveEntry *entries;
+  size_t nentries, entries_size;
+  ByteBuffer data;  /* vertex and triangle arrays */
+  ByteBuffer names; /* null-terminated object names */
+
+  /* Workspace for the object being added */
+  VertexMap vmap;
+  ByteBuffer x, y, z, indices, colours;
+} ArchiveWriter;
+
+void archive_init(ArchiveWriter *archive);
+void archive_free(ArchiveWriter *archive);
+
+/* Empties the directory, names and data, e.g. before converting another
+   file. */
+void archive_reset(ArchiveWriter *archive);
+
+/* Adds a directory entry for an object, and arrays of its coordinates,
+   triangle indices and triangle colours. get_colour, if not null, is
+   called for each primitive in order to override its colour. */
+bool archive_add_object(ArchiveWriter *archive, const char *name,
+                        int object_count, const VertexArray *varray,
+                        const Group *group,
+                        _Optional OutputPrimitivesGetColourFn *get_colour,
+                        void *arg, unsigned int flags);
+
+/* Writes the header and directory, with offsets from the start of the
+   file, followed by the data and names of every object added. */
+bool archive_write(const ArchiveWriter *archive, FILE *out);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,125 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Per-object bump allocator
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "arena.h"
+#include "misc.h"
+
+enum {
+  MinBlockSize = 16 * 1024,
+};
+
+/* Any type can be stored at a multiple of the size of this union */
+typedef union {
+  long double ld;
+  long long ll;
+  void *p;
+  void (*fn)(void);
+} ArenaAlign;
+
+struct ArenaBlock {
+  _Optional ArenaBlock *next;
+  size_t size; /* no. of bytes in data */
+  ArenaAlign data[];
+};
+
+void arena_init(Arena * const arena)
+{
+  assert(arena != NULL);
+  arena->blocks = NULL;
+  arena->used = 0;
+  arena->total = 0;
+}
+
+void arena_free(Arena * const arena)
+{
+  assert(arena != NULL);
+
+  _Optional ArenaBlock *next;
+  for (_Optional ArenaBlock *block = arena->blocks; block != NULL;
+       block = next) {
+    next = block->next;
+    free(block);
+  }
+  arena_init(arena);
+}
+
+static bool add_block(Arena * const arena, size_t const size)
+{
+  assert(arena != NULL);
+
+  if (size > SIZE_MAX - offsetof(ArenaBlock, data)) {
+    return false;
+  }
+
+  _Optional ArenaBlock *const block =
+    malloc(offsetof(ArenaBlock, data) + size);
+  if (block == NULL) {
+    return false;
+  }
+
+  block->next = arena->blocks;
+  block->size = size;
+  arena->blocks = block;
+  arena->used = 0;
+  arena->total += size;
+  return true;
+}
+
+void arena_reset(Arena * const arena)
+{
+  assert(arena != NULL);
+
+  if (arena->blocks != NULL && arena->blocks->next != NULL) {
+    size_t const total = arena->total;
+    arena_free(arena);
+
+    /* Failure isn't fatal because the next allocation will try again */
+    (void)add_block(arena, total);
+  }
+  arena->used = 0;
+}
+
+_Optional void *arena_alloc(Arena * const arena, size_t size)
+{
+  assert(arena != NULL);
+
+  size_t const align = sizeof(ArenaAlign);
+  if (size > SIZE_MAX - align) {
+    return NULL;
+  }
+  size = (size + align - 1) / align * align;
+
+  if (arena->blocks == NULL || arena->blocks->size - arena->used < size) {
+    if (!add_block(arena, size > MinBlockSize ? size : MinBlockSize)) {
+      return NULL;
+    }
+  }
+
+  void *const ptr = (char *)arena->blocks->data + arena->used;
+  arena->used += size;
+  return ptr;
+}
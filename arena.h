@@ -0,0 +1,40 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Per-object bump allocator
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+/* ISO C library headers */
+#include <stddef.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef struct ArenaBlock ArenaBlock;
+
+/* Memory for temporary data which is all discarded at once, e.g. after
+   each object. Once it has grown to fit the largest object, allocating
+   from it doesn't call malloc. Only scratch buffers owned by this program
+   can use it; vertex and primitive storage belongs to 3dObjLib. */
+typedef struct {
+  _Optional ArenaBlock *blocks; /* most recently allocated first */
+  size_t used; /* no. of bytes used in the first block */
+  size_t total; /* size of all blocks */
+} Arena;
+
+void arena_init(Arena *arena);
+void arena_free(Arena *arena);
+
+/* Discards everything allocated. If more than one block was needed then
+   they are replaced by a single block big enough for all of them. */
+void arena_reset(Arena *arena);
+
+/* Allocates size bytes, suitably aligned for any type. The memory
+   remains valid until the arena is next reset or freed. */
+_Optional void *arena_alloc(Arena *arena, size_t size);
+
+#endif /* ARENA_H */
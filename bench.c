@@ -0,0 +1,575 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Micro-benchmarks for the stages of conversion
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+
+/* CBUtilLib headers */
+#include "ArgUtils.h"
+
+/* 3dObjLib headers */
+#include "Vertex.h"
+#include "Group.h"
+#include "Clip.h"
+#include "ObjFile.h"
+
+/* Local headers */
+#include "flags.h"
+#include "parser.h"
+#include "model.h"
+#include "apocgen.h"
+#include "bytebuf.h"
+#include "timer.h"
+#include "version.h"
+#include "misc.h"
+
+enum {
+  DefaultRepeat = 20,
+  MaxRepeat = 100000,
+  IndexRepeat = 1000, /* reading the index is too quick to time once */
+};
+
+/* One stage of conversion, as measured over all objects. */
+typedef struct {
+  double seconds;
+  long int nobjects;
+  double nbytes;
+} Result;
+
+typedef struct {
+  const void *data;
+  size_t size;
+  long int index_offset;
+  int nobjects;
+  const long int *index;
+  int repeat;
+} Bench;
+
+static void report(const char * const stage, const Result * const result)
+{
+  assert(stage != NULL);
+  assert(result != NULL);
+
+  double const seconds = result->seconds > 0.0 ? result->seconds : 1e-9;
+  printf("%-24s %10.3f ms %14.0f objects/s %10.2f MB/s\n", stage,
+         result->seconds * 1000.0, result->nobjects / seconds,
+         result->nbytes / seconds / (1024.0 * 1024.0));
+}
+
+static bool bench_read_index(const Bench * const bench,
+                             Result * const result)
+{
+  assert(bench != NULL);
+  assert(result != NULL);
+
+  _Optional long int *const index = malloc(sizeof(*index) *
+                                            (size_t)bench->nobjects);
+  if (index == NULL) {
+    fputs("Failed to allocate memory for index\n", stderr);
+    return false;
+  }
+
+  int const repeat = bench->repeat * IndexRepeat;
+  double const start = timer_now();
+  bool success = true;
+
+  for (int r = 0; success && r < repeat; ++r) {
+    success = apoc_read_index(bench->data, bench->size, bench->index_offset,
+                              0, bench->nobjects - 1, &*index, 0);
+  }
+
+  free(index);
+  if (!success) {
+    return false;
+  }
+
+  /* Scale the result to bench->repeat passes, like the other stages */
+  result->seconds = (timer_now() - start) / IndexRepeat;
+  result->nobjects = (long int)bench->repeat * bench->nobjects;
+  result->nbytes = (double)result->nobjects * sizeof(int32_t);
+  return true;
+}
+
+static bool bench_parse_vertices(const Bench * const bench,
+                                 ApocContext * const ctx,
+                                 Result * const result)
+{
+  assert(bench != NULL);
+  assert(ctx != NULL);
+  assert(result != NULL);
+
+  double const start = timer_now();
+
+  for (int r = 0; r < bench->repeat; ++r) {
+    for (int object_count = 0; object_count < bench->nobjects;
+         ++object_count) {
+      long int const pos = apoc_parse_vertices(ctx, bench->data,
+        bench->size, bench->index[object_count], object_count, 0);
+      if (pos < 0) {
+        return false;
+      }
+      result->nbytes += pos - bench->index[object_count];
+    }
+  }
+
+  result->seconds = timer_now() - start;
+  result->nobjects = (long int)bench->repeat * bench->nobjects;
+  return true;
+}
+
+/* Times the parsing of primitives (with or without merging duplicate
+   vertices as the primitives are added). */
+static bool bench_parse_primitives(const Bench * const bench,
+                                   ApocContext * const ctx,
+                                   Result * const result,
+                                   const unsigned int flags)
+{
+  assert(bench != NULL);
+  assert(ctx != NULL);
+  assert(result != NULL);
+
+  for (int r = 0; r < bench->repeat; ++r) {
+    for (int object_count = 0; object_count < bench->nobjects;
+         ++object_count) {
+      long int const pos = apoc_parse_vertices(ctx, bench->data,
+        bench->size, bench->index[object_count], object_count, flags);
+      if (pos < 0) {
+        return false;
+      }
+
+      double const start = timer_now();
+      long int const end = apoc_parse_primitives(ctx, bench->data,
+        bench->size, pos, object_count, flags);
+      result->seconds += timer_now() - start;
+      if (end < 0) {
+        return false;
+      }
+      result->nbytes += end - pos;
+    }
+  }
+
+  result->nobjects = (long int)bench->repeat * bench->nobjects;
+  return true;
+}
+
+/* Times the detection of duplicate vertices by comparing all used
+   vertices (as is done after clipping). */
+static bool bench_dedup(const Bench * const bench, ApocContext * const ctx,
+                        Result * const result)
+{
+  assert(bench != NULL);
+  assert(ctx != NULL);
+  assert(result != NULL);
+
+  for (int r = 0; r < bench->repeat; ++r) {
+    for (int object_count = 0; object_count < bench->nobjects;
+         ++object_count) {
+      long int const pos = apoc_parse_vertices(ctx, bench->data,
+        bench->size, bench->index[object_count], object_count,
+        FLAGS_DUPLICATE);
+      if (pos < 0) {
+        return false;
+      }
+      long int const end = apoc_parse_primitives(ctx, bench->data,
+        bench->size, pos, object_count, FLAGS_DUPLICATE);
+      if (end < 0) {
+        return false;
+      }
+      group_set_used(&ctx->group, &ctx->varray);
+
+      double const start = timer_now();
+      int const ndup = vertex_array_find_duplicates(&ctx->varray, false);
+      result->seconds += timer_now() - start;
+      if (ndup < 0) {
+        fputs("Detection of duplicate vertices failed\n", stderr);
+        return false;
+      }
+      result->nbytes += pos - bench->index[object_count];
+    }
+  }
+
+  result->nobjects = (long int)bench->repeat * bench->nobjects;
+  return true;
+}
+
+static bool bench_clip(const Bench * const bench, ApocContext * const ctx,
+                       Result * const result)
+{
+  assert(bench != NULL);
+  assert(ctx != NULL);
+  assert(result != NULL);
+
+  static const int group_order[] = {0};
+  unsigned int const flags = FLAGS_CLIP_POLYGONS;
+
+  for (int r = 0; r < bench->repeat; ++r) {
+    for (int object_count = 0; object_count < bench->nobjects;
+         ++object_count) {
+      long int const pos = apoc_parse_vertices(ctx, bench->data,
+        bench->size, bench->index[object_count], object_count, flags);
+      if (pos < 0) {
+        return false;
+      }
+      long int const end = apoc_parse_primitives(ctx, bench->data,
+        bench->size, pos, object_count, flags);
+      if (end < 0) {
+        return false;
+      }
+
+      double const start = timer_now();
+      bool const clipped = clip_polygons(&ctx->varray, &ctx->group,
+                                         group_order,
+                                         ARRAY_SIZE(group_order), false);
+      result->seconds += timer_now() - start;
+      if (!clipped) {
+        fputs("Clipping of overlapping coplanar polygons failed\n",
+              stderr);
+        return false;
+      }
+      result->nbytes += end - bench->index[object_count];
+    }
+  }
+
+  result->nobjects = (long int)bench->repeat * bench->nobjects;
+  return true;
+}
+
+static int get_material(char *const buf, size_t const buf_size,
+                        int const colour, void *arg)
+{
+  NOT_USED(arg);
+  return snprintf(buf, buf_size, "riscos_%d", colour);
+}
+
+/* Times the OBJ writer alone, with objects prepared from a model. */
+static bool bench_write_obj(const Bench * const bench,
+                            ApocContext * const ctx, FILE * const out,
+                            Result * const result)
+{
+  assert(bench != NULL);
+  assert(ctx != NULL);
+  assert(out != NULL);
+  assert(result != NULL);
+
+  ApocModel model;
+  apoc_model_init(&model);
+  bool success = apoc_model_parse(&model, bench->data, bench->size,
+                                  bench->index_offset, bench->nobjects, 0);
+
+  for (int r = 0; success && r < bench->repeat; ++r) {
+    rewind(out);
+    int vtotal = 0;
+    for (int object_count = 0; success && object_count < bench->nobjects;
+         ++object_count) {
+      int vobject;
+      if (!apoc_model_get_object(&model, object_count, &ctx->varray,
+                                 &ctx->group, &vobject, 0)) {
+        success = false;
+        break;
+      }
+
+      long int const out_start = ftell(out);
+      double const start = timer_now();
+      success = output_vertices(out, vobject, &ctx->varray, -1) &&
+                output_primitives(out, "bench", vtotal, vobject,
+                                  &ctx->varray, &ctx->group, 1, NULL,
+                                  get_material, NULL, VertexStyle_Positive,
+                                  MeshStyle_NoChange);
+      result->seconds += timer_now() - start;
+      if (!success) {
+        fprintf(stderr, "Failed writing to output file: %s\n",
+                strerror(errno));
+        break;
+      }
+      result->nbytes += ftell(out) - out_start;
+      vtotal += vobject;
+    }
+  }
+
+  apoc_model_free(&model);
+  result->nobjects = (long int)bench->repeat * bench->nobjects;
+  return success;
+}
+
+/* Times a whole conversion, for comparison with the sum of the stages. */
+static bool bench_convert(const Bench * const bench,
+                          ApocContext * const ctx, FILE * const out,
+                          Result * const result)
+{
+  assert(bench != NULL);
+  assert(ctx != NULL);
+  assert(out != NULL);
+  assert(result != NULL);
+
+  double const start = timer_now();
+
+  for (int r = 0; r < bench->repeat; ++r) {
+    rewind(out);
+    if (!apoc_to_obj_ctx(ctx, bench->data, bench->size, out, 0,
+                         bench->nobjects - 1, NULL, bench->index_offset,
+                         bench->nobjects, "sf3k.mtl", 1, 0)) {
+      return false;
+    }
+  }
+
+  result->seconds = timer_now() - start;
+  result->nobjects = (long int)bench->repeat * bench->nobjects;
+  /* Generated objects follow the index, in order */
+  result->nbytes = (double)bench->repeat *
+                   (double)(bench->size - (size_t)bench->index[0]);
+  return true;
+}
+
+static bool run_benchmarks(const Bench * const bench, FILE * const out)
+{
+  assert(bench != NULL);
+  assert(out != NULL);
+
+  ApocContext ctx;
+  apoc_context_init(&ctx);
+
+  Result read_index = {0}, vertices = {0}, primitives = {0},
+         primitives_dedup = {0}, dedup = {0}, clip = {0}, write = {0},
+         convert = {0};
+
+  bool const success =
+    bench_read_index(bench, &read_index) &&
+    bench_parse_vertices(bench, &ctx, &vertices) &&
+    bench_parse_primitives(bench, &ctx, &primitives, FLAGS_DUPLICATE) &&
+    bench_parse_primitives(bench, &ctx, &primitives_dedup, 0) &&
+    bench_dedup(bench, &ctx, &dedup) &&
+    bench_clip(bench, &ctx, &clip) &&
+    bench_write_obj(bench, &ctx, out, &write) &&
+    bench_convert(bench, &ctx, out, &convert);
+
+  if (success) {
+    report("read_index", &read_index);
+    report("parse_vertices", &vertices);
+    report("parse_primitives", &primitives);
+    report("parse_primitives+merge", &primitives_dedup);
+    report("find_duplicates", &dedup);
+    report("clip_polygons", &clip);
+    report("write_obj", &write);
+    report("convert", &convert);
+  }
+
+  apoc_context_free(&ctx);
+  return success;
+}
+
+static bool save(const ByteBuffer * const data, const char * const file)
+{
+  assert(data != NULL);
+  assert(file != NULL);
+
+  _Optional FILE *const f = fopen(file, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open output file '%s': %s\n",
+            file, strerror(errno));
+    return false;
+  }
+
+  bool success = fwrite(&*data->data, data->len, 1, &*f) == 1;
+  if (fclose(&*f)) {
+    success = false;
+  }
+  if (!success) {
+    fprintf(stderr, "Failed to write output file '%s': %s\n",
+            file, strerror(errno));
+  }
+  return success;
+}
+
+static bool run(const ApocGenParams * const params, int const repeat,
+                _Optional const char * const save_file)
+{
+  assert(params != NULL);
+  assert(repeat > 0);
+
+  ByteBuffer data;
+  byte_buffer_init(&data);
+  Bench bench = {
+    .nobjects = params->nobjects,
+    .repeat = repeat,
+  };
+
+  _Optional long int *const index = malloc(sizeof(*index) *
+                                            (size_t)params->nobjects);
+  bool success = index != NULL;
+  if (!success) {
+    fputs("Failed to allocate memory for index\n", stderr);
+  } else if (!apoc_generate(params, &data, &bench.index_offset)) {
+    fputs("Failed to generate input\n", stderr);
+    success = false;
+  } else if (save_file != NULL) {
+    success = save(&data, &*save_file);
+  }
+
+  if (success) {
+    bench.data = data.data;
+    bench.size = data.len;
+    bench.index = &*index;
+    success = apoc_read_index(bench.data, bench.size, bench.index_offset, 0,
+                              bench.nobjects - 1, &*index, 0);
+  }
+
+  if (success) {
+    printf("ApocToObj benchmarks, "VERSION_STRING"\n"
+           "%d objects (%d..%d vertices, %d..%d sides, %d%% overlapping, "
+           "%d%% duplicate, %d%% moved), %zu bytes, %d repeats\n\n",
+           params->nobjects, params->min_vertices, params->max_vertices,
+           params->min_sides, params->max_sides, params->overlap,
+           params->duplicate, params->moved, data.len, repeat);
+
+    /* OBJ output goes to a temporary file rather than a memory buffer,
+       so that writes cost what they do in a real conversion */
+    _Optional FILE *const out = tmpfile();
+    if (out == NULL) {
+      fprintf(stderr, "Failed to create temporary file: %s\n",
+              strerror(errno));
+      success = false;
+    } else {
+      success = run_benchmarks(&bench, &*out);
+      fclose(&*out);
+    }
+  }
+
+  byte_buffer_free(&data);
+  free(index);
+  return success;
+}
+
+static int syntax_msg(FILE * const f, const char * const path)
+{
+  assert(f != NULL);
+  assert(path != NULL);
+
+  fprintf(f,
+          "usage: %s [switches]\n"
+          "Generates a synthetic file of polygon meshes and measures the\n"
+          "throughput of each stage of converting it.\n", path);
+
+  fputs("Switches (names may be abbreviated):\n"
+        "  -help               Display this text\n"
+        "  -objects N          No. of objects to generate (default 200)\n"
+        "  -minverts N         Minimum no. of vertices per object\n"
+        "  -maxverts N         Maximum no. of vertices per object\n"
+        "  -minsides N         Minimum no. of sides per primitive\n"
+        "  -maxsides N         Maximum no. of sides per primitive\n"
+        "  -overlap N          Percentage of overlapping coplanar primitives\n"
+        "  -duplicate N        Percentage of reversed duplicate primitives\n"
+        "  -moved N            Percentage of primitives moved in each frame\n"
+        "  -seed N             Seed for the random number generator\n"
+        "  -repeat N           No. of times to repeat each benchmark\n"
+        "  -save <name>        Save the generated file\n", f);
+
+  return EXIT_FAILURE;
+}
+
+int main(int argc, const char *argv[])
+{
+  ApocGenParams params;
+  apoc_gen_params_init(&params);
+  long int repeat = DefaultRepeat;
+  _Optional const char *save_file = NULL;
+
+  assert(argc > 0);
+  assert(argv != NULL);
+
+  for (int n = 1; n < argc; n++) {
+    const char *opt = argv[n] + 1;
+    long int value = 0;
+
+    if (argv[n][0] != '-') {
+      fprintf(stderr, "Unexpected argument '%s'\n", argv[n]);
+      return syntax_msg(stderr, argv[0]);
+    } else if (is_switch(opt, "help", 1)) {
+      (void)syntax_msg(stdout, argv[0]);
+      return EXIT_SUCCESS;
+    } else if (is_switch(opt, "objects", 1)) {
+      if (!get_long_arg("objects", &value, 1, INT_MAX, argc, argv,
+                        ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      /* The index has no spare entries */
+      params.nobjects = params.index_size = (int)value;
+    } else if (is_switch(opt, "minverts", 4)) {
+      if (!get_long_arg("minverts", &value, 1, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.min_vertices = (int)value;
+    } else if (is_switch(opt, "maxverts", 4)) {
+      if (!get_long_arg("maxverts", &value, 1, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.max_vertices = (int)value;
+    } else if (is_switch(opt, "minsides", 4)) {
+      if (!get_long_arg("minsides", &value, 1, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.min_sides = (int)value;
+    } else if (is_switch(opt, "maxsides", 4)) {
+      if (!get_long_arg("maxsides", &value, 1, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.max_sides = (int)value;
+    } else if (is_switch(opt, "overlap", 2)) {
+      if (!get_long_arg("overlap", &value, 0, 100, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.overlap = (int)value;
+    } else if (is_switch(opt, "duplicate", 1)) {
+      if (!get_long_arg("duplicate", &value, 0, 100, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.duplicate = (int)value;
+    } else if (is_switch(opt, "moved", 2)) {
+      if (!get_long_arg("moved", &value, 0, 100, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.moved = (int)value;
+    } else if (is_switch(opt, "seed", 2)) {
+      if (!get_long_arg("seed", &value, 0, INT32_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      params.seed = (uint32_t)value;
+    } else if (is_switch(opt, "repeat", 1)) {
+      if (!get_long_arg("repeat", &repeat, 1, MaxRepeat, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+    } else if (is_switch(opt, "save", 2)) {
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing output file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      save_file = argv[n];
+    } else {
+      fprintf(stderr, "Unrecognised switch '%s'\n", opt);
+      return syntax_msg(stderr, argv[0]);
+    }
+  }
+
+  return run(&params, (int)repeat, save_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
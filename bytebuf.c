@@ -0,0 +1,189 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Growable byte buffer
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+/* Local header files */
+#include "bytebuf.h"
+#include "decode.h"
+#include "misc.h"
+
+enum {
+  MinBufferSize = 4096,
+};
+
+void byte_buffer_init(ByteBuffer * const buf)
+{
+  assert(buf != NULL);
+  buf->data = NULL;
+  buf->len = 0;
+  buf->size = 0;
+}
+
+void byte_buffer_free(ByteBuffer * const buf)
+{
+  assert(buf != NULL);
+  free(buf->data);
+  byte_buffer_init(buf);
+}
+
+void byte_buffer_reset(ByteBuffer * const buf)
+{
+  assert(buf != NULL);
+  buf->len = 0;
+}
+
+/* Makes room for at least len more bytes. */
+static bool reserve(ByteBuffer * const buf, size_t const len)
+{
+  assert(buf != NULL);
+
+  if (buf->size - buf->len >= len) {
+    return true;
+  }
+
+  if (len > SIZE_MAX / 2 - buf->len) {
+    fputs("Output is too big\n", stderr);
+    return false;
+  }
+
+  size_t new_size = buf->size ? buf->size : MinBufferSize;
+  while (new_size - buf->len < len) {
+    new_size *= 2;
+  }
+
+  _Optional unsigned char *const new_data = realloc(buf->data, new_size);
+  if (new_data == NULL) {
+    fputs("Failed to allocate memory for output\n", stderr);
+    return false;
+  }
+  buf->data = new_data;
+  buf->size = new_size;
+  return true;
+}
+
+bool byte_buffer_append(ByteBuffer * const buf, const void * const data,
+                        size_t const len)
+{
+  assert(buf != NULL);
+  assert(data != NULL || len == 0);
+
+  if (len == 0) {
+    return true;
+  }
+  if (!reserve(buf, len)) {
+    return false;
+  }
+  memcpy(&*buf->data + buf->len, data, len);
+  buf->len += len;
+  return true;
+}
+
+_Optional unsigned char *byte_buffer_extend(ByteBuffer * const buf,
+                                            size_t const len)
+{
+  assert(buf != NULL);
+
+  if (!reserve(buf, len)) {
+    return NULL;
+  }
+  unsigned char *const data = &*buf->data + buf->len;
+  buf->len += len;
+  return data;
+}
+
+bool byte_buffer_fill(ByteBuffer * const buf, int const value,
+                      size_t const len)
+{
+  assert(buf != NULL);
+
+  if (len == 0) {
+    return true;
+  }
+  if (!reserve(buf, len)) {
+    return false;
+  }
+  memset(&*buf->data + buf->len, value, len);
+  buf->len += len;
+  return true;
+}
+
+bool byte_buffer_append_le16(ByteBuffer * const buf, uint16_t const value)
+{
+  assert(buf != NULL);
+  unsigned char const bytes[] = {
+    value & 0xff, (value >> 8) & 0xff,
+  };
+  return byte_buffer_append(buf, bytes, sizeof(bytes));
+}
+
+bool byte_buffer_append_le32(ByteBuffer * const buf, uint32_t const value)
+{
+  assert(buf != NULL);
+  unsigned char bytes[4];
+  encode_uint32(bytes, value);
+  return byte_buffer_append(buf, bytes, sizeof(bytes));
+}
+
+bool byte_buffer_append_float(ByteBuffer * const buf, float const value)
+{
+  assert(buf != NULL);
+
+  /* Assumes that float is IEEE 754 single precision */
+  uint32_t bits;
+  assert(sizeof(bits) == sizeof(value));
+  memcpy(&bits, &value, sizeof(bits));
+  return byte_buffer_append_le32(buf, bits);
+}
+
+bool byte_buffer_printf(ByteBuffer * const buf, const char * const format,
+                        ...)
+{
+  assert(buf != NULL);
+  assert(format != NULL);
+
+  va_list args;
+  va_start(args, format);
+  int const len = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+
+  if (len < 0) {
+    fputs("Failed to format output\n", stderr);
+    return false;
+  }
+
+  /* Room for the terminator written by vsnprintf */
+  if (!reserve(buf, (size_t)len + 1)) {
+    return false;
+  }
+
+  va_start(args, format);
+  (void)vsnprintf((char *)&*buf->data + buf->len, (size_t)len + 1, format,
+                  args);
+  va_end(args);
+
+  buf->len += (size_t)len;
+  return true;
+}
@@ -0,0 +1,50 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Growable byte buffer
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef BYTEBUF_H
+#define BYTEBUF_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Output which must be complete before it can be written, e.g. because
+   its length is written first. */
+typedef struct {
+  _Optional unsigned char *data;
+  size_t len;
+  size_t size; /* no. of bytes allocated */
+} ByteBuffer;
+
+void byte_buffer_init(ByteBuffer *buf);
+void byte_buffer_free(ByteBuffer *buf);
+
+/* Empties a buffer without freeing its memory. */
+void byte_buffer_reset(ByteBuffer *buf);
+
+bool byte_buffer_append(ByteBuffer *buf, const void *data, size_t len);
+
+/* Makes the buffer len bytes longer and returns the address of those
+   bytes, which are uninitialised, e.g. to read data into them. */
+_Optional unsigned char *byte_buffer_extend(ByteBuffer *buf, size_t len);
+
+/* Appends bytes with the given value, e.g. for alignment. */
+bool byte_buffer_fill(ByteBuffer *buf, int value, size_t len);
+
+/* Append values in little-endian byte order. */
+bool byte_buffer_append_le16(ByteBuffer *buf, uint16_t value);
+bool byte_buffer_append_le32(ByteBuffer *buf, uint32_t value);
+bool byte_buffer_append_float(ByteBuffer *buf, float value);
+
+/* Appends formatted text, without a terminator. */
+bool byte_buffer_printf(ByteBuffer *buf, const char *format, ...);
+
+#endif /* BYTEBUF_H */
@@ -0,0 +1,180 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Sidecar cache of object summaries
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* Local header files */
+#include "cache.h"
+#include "decode.h"
+#include "misc.h"
+
+/* All values are stored little-endian, as in the input. */
+enum {
+  CacheVersion = 1,
+  HeaderSize = 4 + 4 + 8 * 4 + 4 + 4,
+  EntrySize = 8 + 8 + 4 + 4,
+};
+
+static const unsigned char magic[4] = {'A', 'p', 'I', 'x'};
+
+uint64_t cache_hash(const void *const data, size_t const size)
+{
+  assert(data != NULL || size == 0);
+
+  /* 64-bit FNV-1a */
+  const unsigned char *const bytes = data;
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= UINT64_C(0x100000001b3);
+  }
+  return hash;
+}
+
+static void encode_header(unsigned char *const dst, const CacheKey *const key)
+{
+  assert(dst != NULL);
+  assert(key != NULL);
+
+  memcpy(dst, magic, sizeof(magic));
+  encode_uint32(dst + 4, CacheVersion);
+  encode_uint64(dst + 8, key->file_size);
+  encode_uint64(dst + 16, (uint64_t)key->mtime);
+  encode_uint64(dst + 24, key->hash);
+  encode_uint64(dst + 32, (uint64_t)key->index_offset);
+  encode_uint32(dst + 40, key->flats);
+  encode_uint32(dst + 44, (uint32_t)key->count);
+}
+
+bool cache_load(const char *const file_name, const CacheKey *const key,
+                const bool check_hash, ApocObjectInfo *const objects)
+{
+  assert(file_name != NULL);
+  assert(key != NULL);
+  assert(key->count > 0);
+  assert(objects != NULL);
+
+  size_t const size = HeaderSize + ((size_t)key->count * EntrySize);
+  _Optional unsigned char *const buf = malloc(size + 1);
+  if (buf == NULL) {
+    return false;
+  }
+
+  bool match = false;
+  _Optional FILE *const f = fopen(file_name, "rb");
+  if (f != NULL) {
+    /* Reading one byte more than expected detects a longer file */
+    match = fread(&*buf, 1, size + 1, &*f) == size;
+    fclose(&*f);
+  }
+
+  if (match) {
+    unsigned char expected[HeaderSize];
+    encode_header(expected, key);
+    if (check_hash) {
+      memcpy(expected + 16, &*buf + 16, 8); /* any modification time */
+    } else {
+      memcpy(expected + 24, &*buf + 24, 8); /* any hash */
+    }
+    match = !memcmp(&*buf, expected, sizeof(expected));
+  }
+
+  for (int i = 0; match && i < key->count; ++i) {
+    const unsigned char *const src = &*buf + HeaderSize +
+                                     ((size_t)i * EntrySize);
+    int64_t const file_pos = decode_int64(src);
+    int64_t const obj_size = decode_int64(src + 8);
+    if (file_pos < 0 || file_pos > LONG_MAX ||
+        obj_size < 0 || obj_size > LONG_MAX) {
+      match = false;
+      break;
+    }
+    objects[i].file_pos = (long int)file_pos;
+    objects[i].size = (long int)obj_size;
+    objects[i].nvertices = decode_int32(src + 16);
+    objects[i].nprimitives = decode_int32(src + 20);
+  }
+
+  free(buf);
+  return match;
+}
+
+bool cache_save(const char *const file_name, const CacheKey *const key,
+                const ApocObjectInfo *const objects)
+{
+  assert(file_name != NULL);
+  assert(key != NULL);
+  assert(key->count > 0);
+  assert(objects != NULL);
+
+  size_t const size = HeaderSize + ((size_t)key->count * EntrySize);
+  _Optional unsigned char *const buf = malloc(size);
+  if (buf == NULL) {
+    fputs("Failed to allocate memory for object cache\n", stderr);
+    return false;
+  }
+
+  /* A file could be modified again within the second that it was last
+     modified without changing its modification time or size, so the
+     time is only recorded once it has passed. Until then, the input must
+     be hashed to use the cache. */
+  CacheKey saved = *key;
+  time_t const now = time(NULL);
+  if (now == (time_t)-1 || (int64_t)now <= key->mtime) {
+    saved.mtime = -1;
+  }
+
+  encode_header(&*buf, &saved);
+  for (int i = 0; i < key->count; ++i) {
+    unsigned char *const dst = &*buf + HeaderSize + ((size_t)i * EntrySize);
+    encode_uint64(dst, (uint64_t)objects[i].file_pos);
+    encode_uint64(dst + 8, (uint64_t)objects[i].size);
+    encode_uint32(dst + 16, (uint32_t)objects[i].nvertices);
+    encode_uint32(dst + 20, (uint32_t)objects[i].nprimitives);
+  }
+
+  bool success = false;
+  _Optional FILE *const f = fopen(file_name, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open cache file '%s': %s\n",
+            file_name, strerror(errno));
+  } else {
+    success = fwrite(&*buf, 1, size, &*f) == size;
+    if (fclose(&*f)) {
+      success = false;
+    }
+    if (!success) {
+      fprintf(stderr, "Failed writing to cache file '%s': %s\n",
+              file_name, strerror(errno));
+      remove(file_name);
+    }
+  }
+
+  free(buf);
+  return success;
+}
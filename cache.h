@@ -0,0 +1,43 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Sidecar cache of object summaries
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Local headers */
+#include "parser.h"
+
+/* A cache is only used if all of these match the input. */
+typedef struct {
+  uint64_t file_size;
+  int64_t mtime;        /* or -1 if unknown */
+  uint64_t hash;        /* of the whole input */
+  int64_t index_offset;
+  uint32_t flats;       /* 1 if the index is of flats */
+  int32_t count;        /* no. of objects in the index */
+} CacheKey;
+
+uint64_t cache_hash(const void *data, size_t size);
+
+/* Reads objects[0 .. key->count-1] from a cache file. Returns false
+   (without reporting an error) if the file is missing, malformed or
+   doesn't match the key. If check_hash is true then the hash must match
+   but the modification time needn't; otherwise the reverse, so that the
+   input needn't be hashed if it has the same modification time. */
+bool cache_load(const char *file_name, const CacheKey *key, bool check_hash,
+                ApocObjectInfo *objects);
+
+/* Writes objects[0 .. key->count-1] to a cache file. The modification
+   time isn't recorded if it is the current second. */
+bool cache_save(const char *file_name, const CacheKey *key,
+                const ApocObjectInfo *objects);
+
+#endif /* CACHE_H */
@@ -95,3 +95,17 @@ const char *get_colour_name(const int colour)
   assert((size_t)colour < ARRAY_SIZE(colour_names));
   return colour_names[colour];
 }
+
+void get_colour_components(const int colour, int (*const rgb)[3])
+{
+  assert(colour >= 0);
+  assert(colour <= 0xff);
+  assert(rgb != NULL);
+
+  /* Bits are B3 G3 G2 R3 B2 R2 T1 T0, where T is the tint added to
+     every component */
+  int const tint = colour & 3;
+  (*rgb)[0] = (((colour >> 4) & 1) << 3) | (((colour >> 2) & 1) << 2) | tint;
+  (*rgb)[1] = (((colour >> 6) & 1) << 3) | (((colour >> 5) & 1) << 2) | tint;
+  (*rgb)[2] = (((colour >> 7) & 1) << 3) | (((colour >> 3) & 1) << 2) | tint;
+}
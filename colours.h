@@ -9,4 +9,12 @@
 
 const char *get_colour_name(int colour);
 
+enum {
+  MaxColourComponent = 15,
+};
+
+/* Gets the red, green and blue components (0 to MaxColourComponent) of a
+   colour in the default 256-colour palette. */
+void get_colour_components(int colour, int (*rgb)[3]);
+
 #endif /* COLOURS_H */
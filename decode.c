@@ -0,0 +1,107 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Little-endian integer decoding
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stddef.h>
+#include <stdint.h>
+
+/* x86 is always little-endian, so the input can be loaded directly into
+   vector registers without byte swapping. */
+#if defined(__AVX__)
+#define DECODE_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DECODE_SSE2
+#include <emmintrin.h>
+#endif
+
+/* 3dObjLib headers */
+#include "Coord.h"
+
+/* Local header files */
+#include "decode.h"
+#include "misc.h"
+
+#if defined(DECODE_AVX) || defined(DECODE_SSE2)
+/* Fails to compile if vector stores of doubles can't be used for Coord */
+typedef char coord_size_check[sizeof(Coord) == sizeof(double) ? 1 : -1];
+#endif
+
+int32_t decode_int32(const unsigned char *const src)
+{
+  assert(src != NULL);
+  return (int32_t)((uint32_t)src[0] | ((uint32_t)src[1] << 8) |
+                   ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24));
+}
+
+/* Two's complement is assumed when converting back to a signed value */
+int64_t decode_int64(const unsigned char *const src)
+{
+  assert(src != NULL);
+
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value |= (uint64_t)src[i] << (8 * i);
+  }
+  return value > INT64_MAX ? -(int64_t)(UINT64_MAX - value) - 1 :
+                             (int64_t)value;
+}
+
+void encode_uint32(unsigned char *const dst, uint32_t const value)
+{
+  assert(dst != NULL);
+  for (int i = 0; i < 4; ++i) {
+    dst[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+void encode_uint64(unsigned char *const dst, uint64_t const value)
+{
+  assert(dst != NULL);
+  for (int i = 0; i < 8; ++i) {
+    dst[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+void decode_coords(const unsigned char *src, Coord *dst, size_t const n)
+{
+  assert(src != NULL || n == 0);
+  assert(dst != NULL || n == 0);
+
+  size_t i = 0;
+
+#if defined(DECODE_AVX)
+  for (; n - i >= 4; i += 4, src += 16) {
+    __m128i const ints = _mm_loadu_si128((const __m128i *)src);
+    _mm256_storeu_pd(dst + i, _mm256_cvtepi32_pd(ints));
+  }
+#elif defined(DECODE_SSE2)
+  for (; n - i >= 4; i += 4, src += 16) {
+    __m128i const ints = _mm_loadu_si128((const __m128i *)src);
+    _mm_storeu_pd(dst + i, _mm_cvtepi32_pd(ints));
+    _mm_storeu_pd(dst + i + 2, _mm_cvtepi32_pd(_mm_srli_si128(ints, 8)));
+  }
+#endif
+
+  for (; i < n; ++i, src += sizeof(int32_t)) {
+    dst[i] = decode_int32(src);
+  }
+}
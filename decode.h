@@ -0,0 +1,29 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Little-endian integer encoding and decoding
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+/* ISO C library headers */
+#include <stddef.h>
+#include <stdint.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+
+int32_t decode_int32(const unsigned char *src);
+int64_t decode_int64(const unsigned char *src);
+
+/* Store values in little-endian byte order. The destination need not be
+   aligned. */
+void encode_uint32(unsigned char *dst, uint32_t value);
+void encode_uint64(unsigned char *dst, uint64_t value);
+
+/* Converts an array of n little-endian signed 32-bit integers to
+   coordinates. The source need not be aligned. */
+void decode_coords(const unsigned char *src, Coord *dst, size_t n);
+
+#endif /* DECODE_H */
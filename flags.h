@@ -20,6 +20,12 @@
 #define FLAGS_DUPLICATE          (1u<<10) /* emit duplicate vertices */
 #define FLAGS_HUMAN_READABLE     (1u<<11) /* use human-readable material names */
 #define FLAGS_FLIP_BACKFACING    (1u<<12) /* flip backfacing polygons */
-#define FLAGS_ALL                ((1u<<13)-1)
+#define FLAGS_SHARE_VERTICES     (1u<<13) /* share vertices between frames */
+#define FLAGS_GLB                (1u<<14) /* write binary glTF instead of OBJ */
+#define FLAGS_PLY                (1u<<15) /* write binary PLY instead of OBJ */
+#define FLAGS_ARCHIVE            (1u<<16) /* write a mesh archive instead of OBJ */
+#define FLAGS_ALL                ((1u<<17)-1)
+
+#define FLAGS_BINARY (FLAGS_GLB | FLAGS_PLY | FLAGS_ARCHIVE) /* any binary format */
 
 #endif /* FLAGS_H */
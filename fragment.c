@@ -0,0 +1,232 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Cache of converted objects
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+/* CBUtilLib headers */
+#include "StringBuff.h"
+
+/* Local header files */
+#include "fragment.h"
+#include "cache.h"
+#include "misc.h"
+
+/* Each file holds a line identifying the format, the key (to detect
+   collisions between hashes of different keys), a line of counts and then
+   the OBJ-format text. */
+static const char file_id[] = "ApocToObj fragment 1";
+
+enum {
+  MaxHeaderLen = 127,
+};
+
+void fragment_init(Fragment * const frag)
+{
+  assert(frag != NULL);
+  byte_buffer_init(&frag->text);
+  frag->vobject = 0;
+  frag->summary.file_pos = 0;
+  frag->summary.size = 0;
+  frag->summary.nvertices = 0;
+  frag->summary.nprimitives = 0;
+}
+
+void fragment_free(Fragment * const frag)
+{
+  assert(frag != NULL);
+  byte_buffer_free(&frag->text);
+}
+
+/* Files are named after a hash of the key. */
+static bool get_file_name(StringBuffer * const file_name,
+                          const char * const dir, const char * const key)
+{
+  assert(file_name != NULL);
+  assert(dir != NULL);
+  assert(key != NULL);
+
+  char leaf[17];
+  snprintf(leaf, sizeof(leaf), "%016" PRIx64,
+           cache_hash(key, strlen(key)));
+
+  return stringbuffer_append(file_name, dir, SIZE_MAX) &&
+         stringbuffer_append_separated(file_name, PATH_SEPARATOR, leaf);
+}
+
+/* Reads a line into buf and checks that it matches the expected text. */
+static bool read_line(FILE * const f, char * const buf, size_t const size,
+                      _Optional const char * const expected)
+{
+  assert(f != NULL);
+  assert(buf != NULL);
+  assert(size > 0);
+
+  if (fgets(buf, (int)size, f) == NULL) {
+    return false;
+  }
+
+  size_t const len = strlen(buf);
+  if (len == 0 || buf[len - 1] != '\n') {
+    return false;
+  }
+  buf[len - 1] = '\0';
+
+  return expected == NULL || !strcmp(buf, &*expected);
+}
+
+bool fragment_load(const char * const dir, const char * const key,
+                   Fragment * const frag)
+{
+  assert(dir != NULL);
+  assert(key != NULL);
+  assert(frag != NULL);
+
+  StringBuffer file_name;
+  stringbuffer_init(&file_name);
+  if (!get_file_name(&file_name, dir, key)) {
+    stringbuffer_destroy(&file_name);
+    return false;
+  }
+
+  _Optional FILE *const f = fopen(stringbuffer_get_pointer(&file_name), "rb");
+  stringbuffer_destroy(&file_name);
+  if (f == NULL) {
+    return false;
+  }
+
+  /* Big enough for the newline and terminator after either line */
+  size_t const line_size = strlen(key) + sizeof(file_id) + 1;
+  _Optional char *const line = malloc(line_size);
+  bool found = false;
+
+  if (line != NULL &&
+      read_line(&*f, &*line, line_size, file_id) &&
+      read_line(&*f, &*line, line_size, key)) {
+    char counts[MaxHeaderLen + 1];
+    long int size, len;
+    int vobject;
+    int32_t nvertices, nprimitives;
+
+    if (read_line(&*f, counts, sizeof(counts), NULL) &&
+        sscanf(counts, "%d %ld %" SCNd32 " %" SCNd32 " %ld", &vobject, &size,
+               &nvertices, &nprimitives, &len) == 5 &&
+        vobject >= 0 && size >= 0 && len >= 0) {
+      /* Reading one byte more than expected detects a longer file */
+      byte_buffer_reset(&frag->text);
+      _Optional unsigned char *const text =
+        byte_buffer_extend(&frag->text, (size_t)len + 1);
+      if (text != NULL &&
+          fread(&*text, 1, (size_t)len + 1, &*f) == (size_t)len) {
+        frag->text.len = (size_t)len;
+        frag->vobject = vobject;
+        frag->summary.size = size;
+        frag->summary.nvertices = nvertices;
+        frag->summary.nprimitives = nprimitives;
+        found = true;
+      } else {
+        byte_buffer_reset(&frag->text);
+      }
+    }
+  }
+
+  free(line);
+  fclose(&*f);
+  return found;
+}
+
+bool fragment_save(const char * const dir, const char * const key,
+                   const Fragment * const frag)
+{
+  assert(dir != NULL);
+  assert(key != NULL);
+  assert(frag != NULL);
+
+  StringBuffer file_name;
+  stringbuffer_init(&file_name);
+  if (!get_file_name(&file_name, dir, key)) {
+    fputs("Failed to allocate memory for cache file path\n", stderr);
+    stringbuffer_destroy(&file_name);
+    return false;
+  }
+
+  /* Write to a temporary file in the same directory and then rename it,
+     so that a reader never sees a partly written file. The suffix only
+     has to be unlikely to be used by another thread or process. */
+  const char *const name = stringbuffer_get_pointer(&file_name);
+  StringBuffer tmp_name;
+  stringbuffer_init(&tmp_name);
+  char suffix[2 * sizeof(unsigned long) * 2 + 5];
+  snprintf(suffix, sizeof(suffix), "%lx%lxtmp",
+           (unsigned long)time(NULL) ^ (unsigned long)clock(),
+           (unsigned long)(uintptr_t)&tmp_name);
+
+  if (!stringbuffer_append(&tmp_name, name, SIZE_MAX) ||
+      !stringbuffer_append_separated(&tmp_name, EXT_SEPARATOR, suffix)) {
+    fputs("Failed to allocate memory for cache file path\n", stderr);
+    stringbuffer_destroy(&tmp_name);
+    stringbuffer_destroy(&file_name);
+    return false;
+  }
+
+  const char *const tmp = stringbuffer_get_pointer(&tmp_name);
+  bool success = false;
+  _Optional FILE *const f = fopen(tmp, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open cache file '%s': %s\n",
+            tmp, strerror(errno));
+  } else {
+    success = fprintf(&*f, "%s\n%s\n%d %ld %" PRId32 " %" PRId32 " %ld\n",
+                      file_id, key, frag->vobject, frag->summary.size,
+                      frag->summary.nvertices, frag->summary.nprimitives,
+                      (long int)frag->text.len) > 0 &&
+              (frag->text.len == 0 ||
+               fwrite(&*frag->text.data, 1, frag->text.len, &*f) ==
+                 frag->text.len);
+
+    if (fclose(&*f)) {
+      success = false;
+    }
+    if (!success) {
+      fprintf(stderr, "Failed writing to cache file '%s': %s\n",
+              tmp, strerror(errno));
+    } else if (rename(tmp, name) &&
+               /* Some systems won't replace an existing file */
+               (remove(name) || rename(tmp, name))) {
+      fprintf(stderr, "Failed to rename cache file '%s' as '%s': %s\n",
+              tmp, name, strerror(errno));
+      success = false;
+    }
+    if (!success) {
+      remove(tmp);
+    }
+  }
+
+  stringbuffer_destroy(&tmp_name);
+  stringbuffer_destroy(&file_name);
+  return success;
+}
@@ -0,0 +1,41 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Cache of converted objects
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Local headers */
+#include "parser.h"
+#include "bytebuf.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* The OBJ-format output for one object, with vertex indices numbered as if
+   it were the first object in the file. */
+typedef struct {
+  ByteBuffer text;
+  int vobject;            /* no. of vertices output */
+  ApocObjectInfo summary; /* file_pos is not stored */
+} Fragment;
+
+void fragment_init(Fragment *frag);
+void fragment_free(Fragment *frag);
+
+/* Reads the fragment stored under the given key in a cache directory.
+   Returns false (without reporting an error) if there is none. */
+bool fragment_load(const char *dir, const char *key, Fragment *frag);
+
+/* Stores a fragment under the given key in a cache directory, which must
+   already exist. */
+bool fragment_save(const char *dir, const char *key, const Fragment *frag);
+
+#endif /* FRAGMENT_H */
@@ -0,0 +1,542 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Binary glTF output
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local header files */
+#include "glb.h"
+#include "bytebuf.h"
+#include "meshout.h"
+#include "decode.h"
+#include "colours.h"
+#include "flags.h"
+#include "version.h"
+#include "misc.h"
+
+enum {
+  GlbMagic = 0x46546c67,     /* "glTF" */
+  GlbVersion = 2,
+  ChunkTypeJSON = 0x4e4f534a, /* "JSON" */
+  ChunkTypeBIN = 0x004e4942,  /* "BIN\0" */
+  HeaderSize = 12,
+  ChunkHeaderSize = 8,
+  ChunkAlignment = 4,
+  ComponentTypeUnsignedShort = 5123,
+  ComponentTypeUnsignedInt = 5125,
+  ComponentTypeFloat = 5126,
+  TargetArrayBuffer = 34962,
+  TargetElementArrayBuffer = 34963,
+  MaxShortIndex = 65534, /* 65535 is reserved for primitive restart */
+  MaxMaterialNameLen = 63,
+};
+
+/* glTF colours are linear, whereas palette entries are sRGB */
+static const float linear_component[MaxColourComponent + 1] = {
+  0.000000f, 0.005605f, 0.015996f, 0.033105f, 0.057805f, 0.090842f,
+  0.132868f, 0.184475f, 0.246201f, 0.318547f, 0.401978f, 0.496933f,
+  0.603827f, 0.723055f, 0.854993f, 1.000000f,
+};
+
+/* State while adding the vertices of one object */
+typedef struct {
+  GlbWriter *glb;
+  const VertexArray *varray;
+  float min[3], max[3];
+} MeshBuilder;
+
+void glb_init(GlbWriter * const glb)
+{
+  assert(glb != NULL);
+
+  byte_buffer_init(&glb->bin);
+  byte_buffer_init(&glb->nodes);
+  byte_buffer_init(&glb->meshes);
+  byte_buffer_init(&glb->accessors);
+  byte_buffer_init(&glb->views);
+  vertex_map_init(&glb->vmap);
+  glb->prim_colour = NULL;
+  glb->prim_colour_size = 0;
+  glb_reset(glb);
+}
+
+void glb_free(GlbWriter * const glb)
+{
+  assert(glb != NULL);
+
+  byte_buffer_free(&glb->bin);
+  byte_buffer_free(&glb->nodes);
+  byte_buffer_free(&glb->meshes);
+  byte_buffer_free(&glb->accessors);
+  byte_buffer_free(&glb->views);
+  vertex_map_free(&glb->vmap);
+  free(glb->prim_colour);
+  glb_init(glb);
+}
+
+void glb_reset(GlbWriter * const glb)
+{
+  assert(glb != NULL);
+
+  byte_buffer_reset(&glb->bin);
+  byte_buffer_reset(&glb->nodes);
+  byte_buffer_reset(&glb->meshes);
+  byte_buffer_reset(&glb->accessors);
+  byte_buffer_reset(&glb->views);
+  glb->nnodes = glb->nmeshes = glb->naccessors = glb->nviews = 0;
+  for (size_t c = 0; c < ARRAY_SIZE(glb->material); ++c) {
+    glb->material[c] = -1;
+  }
+  glb->nmaterials = 0;
+}
+
+/* Outputs a vertex unless it (or a duplicate) has been output already. */
+static bool add_vertex(MeshBuilder * const mb, int const v)
+{
+  assert(mb != NULL);
+  GlbWriter *const glb = mb->glb;
+
+  bool added;
+  if (vertex_map_add(&glb->vmap, mb->varray, v, &added) < 0) {
+    return false;
+  }
+  if (!added) {
+    return true;
+  }
+
+  _Optional Coord (*const coords)[3] =
+    vertex_array_get_coords(mb->varray, v);
+  assert(coords != NULL);
+
+  for (size_t i = 0; i < ARRAY_SIZE(*coords); ++i) {
+    float const value = (float)(*coords)[i];
+    if (glb->vmap.count == 1 || value < mb->min[i]) {
+      mb->min[i] = value;
+    }
+    if (glb->vmap.count == 1 || value > mb->max[i]) {
+      mb->max[i] = value;
+    }
+    if (!byte_buffer_append_float(&glb->bin, value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool add_index(ByteBuffer * const bin, int const index,
+                      bool const is_short)
+{
+  assert(bin != NULL);
+  assert(index >= 0);
+  return is_short ? byte_buffer_append_le16(bin, (uint16_t)index) :
+                    byte_buffer_append_le32(bin, (uint32_t)index);
+}
+
+static bool add_triangles(GlbWriter * const glb, const Primitive * const pp,
+                          bool const is_short, const unsigned int flags)
+{
+  assert(glb != NULL);
+  assert(pp != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int const nsides = primitive_get_num_sides(pp);
+  for (int t = 0; t < nsides - 2; ++t) {
+    int sides[3];
+    get_triangle(nsides, t, flags, &sides);
+    for (size_t k = 0; k < ARRAY_SIZE(sides); ++k) {
+      int const v = primitive_get_side(pp, sides[k]);
+      if (!add_index(&glb->bin, vertex_map_get(&glb->vmap, v), is_short)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool append_json_string(ByteBuffer * const buf, const char *s)
+{
+  assert(buf != NULL);
+  assert(s != NULL);
+
+  if (!byte_buffer_append(buf, "\"", 1)) {
+    return false;
+  }
+  for (; *s != '\0'; ++s) {
+    unsigned char const c = (unsigned char)*s;
+    bool const ok = (c == '"' || c == '\\') ?
+                      byte_buffer_printf(buf, "\\%c", c) :
+                    (c < 0x20) ? byte_buffer_printf(buf, "\\u%04x", c) :
+                                 byte_buffer_append(buf, &c, 1);
+    if (!ok) {
+      return false;
+    }
+  }
+  return byte_buffer_append(buf, "\"", 1);
+}
+
+/* Adds a view of the data appended to the binary buffer since start, and
+   pads the buffer for the next view. */
+static bool add_view(GlbWriter * const glb, size_t const start,
+                     int const target)
+{
+  assert(glb != NULL);
+  assert(start <= glb->bin.len);
+
+  if (!byte_buffer_printf(&glb->views,
+                          "%s{\"buffer\":0,\"byteOffset\":%lu,"
+                          "\"byteLength\":%lu,\"target\":%d}",
+                          glb->nviews ? "," : "", (unsigned long)start,
+                          (unsigned long)(glb->bin.len - start), target)) {
+    return false;
+  }
+  ++glb->nviews;
+
+  size_t const misalign = glb->bin.len % ChunkAlignment;
+  return byte_buffer_fill(&glb->bin, 0,
+                          misalign ? ChunkAlignment - misalign : 0);
+}
+
+static bool add_node(GlbWriter * const glb, const char * const name,
+                     int const mesh)
+{
+  assert(glb != NULL);
+  assert(name != NULL);
+
+  if (!byte_buffer_printf(&glb->nodes, "%s{\"name\":",
+                          glb->nnodes ? "," : "") ||
+      !append_json_string(&glb->nodes, name) ||
+      (mesh >= 0 && !byte_buffer_printf(&glb->nodes, ",\"mesh\":%d", mesh)) ||
+      !byte_buffer_printf(&glb->nodes, "}")) {
+    return false;
+  }
+  ++glb->nnodes;
+  return true;
+}
+
+bool glb_add_object(GlbWriter * const glb, const char * const name,
+                    const VertexArray * const varray,
+                    const Group * const group,
+                    _Optional OutputPrimitivesGetColourFn * const get_colour,
+                    void * const arg, const unsigned int flags)
+{
+  assert(glb != NULL);
+  assert(name != NULL);
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int const nvertices = vertex_array_get_num_vertices(varray);
+  int const nprimitives = group_get_num_primitives(group);
+
+  MeshBuilder mb = {
+    .glb = glb,
+    .varray = varray,
+  };
+
+  if (!vertex_map_start(&glb->vmap, varray, flags) ||
+      !grow_int_array(&glb->prim_colour, &glb->prim_colour_size,
+                      (size_t)nprimitives)) {
+    return false;
+  }
+
+  /* Vertex positions are output first, in order of first use */
+  size_t const positions_start = glb->bin.len;
+  if (flags & FLAGS_UNUSED) {
+    for (int v = 0; v < nvertices; ++v) {
+      if (!add_vertex(&mb, v)) {
+        return false;
+      }
+    }
+  }
+
+  long int ntriangles[GlbNumColours] = {0};
+  int first_prim[GlbNumColours], last_prim[GlbNumColours];
+  bool any = false;
+
+  for (int p = 0; p < nprimitives; ++p) {
+    glb->prim_colour[p] = -1;
+
+    _Optional const Primitive *const pp = group_get_primitive(group, p);
+    if (pp == NULL) {
+      continue;
+    }
+
+    int const nsides = primitive_get_num_sides(&*pp);
+    if (nsides < 3) {
+      continue;
+    }
+
+    int const colour = get_colour ? get_colour(&*pp, arg) :
+                                    primitive_get_colour(&*pp);
+    assert(colour >= 0);
+    assert(colour < GlbNumColours);
+
+    for (int s = 0; s < nsides; ++s) {
+      if (!add_vertex(&mb, primitive_get_side(&*pp, s))) {
+        return false;
+      }
+    }
+
+    glb->prim_colour[p] = colour;
+    if (ntriangles[colour] == 0) {
+      first_prim[colour] = p;
+    }
+    last_prim[colour] = p;
+    ntriangles[colour] += nsides - 2;
+    any = true;
+  }
+
+  if (!any) {
+    /* A mesh must have at least one primitive */
+    glb->bin.len = positions_start;
+    return add_node(glb, name, -1);
+  }
+
+  int const positions = glb->naccessors++;
+  if (!byte_buffer_printf(&glb->accessors,
+                          "%s{\"bufferView\":%d,\"componentType\":%d,"
+                          "\"count\":%d,\"type\":\"VEC3\","
+                          "\"min\":[%.9g,%.9g,%.9g],"
+                          "\"max\":[%.9g,%.9g,%.9g]}",
+                          positions ? "," : "", glb->nviews,
+                          ComponentTypeFloat, glb->vmap.count,
+                          mb.min[0], mb.min[1], mb.min[2],
+                          mb.max[0], mb.max[1], mb.max[2]) ||
+      !add_view(glb, positions_start, TargetArrayBuffer)) {
+    return false;
+  }
+
+  if (!byte_buffer_printf(&glb->meshes, "%s{\"name\":",
+                          glb->nmeshes ? "," : "") ||
+      !append_json_string(&glb->meshes, name) ||
+      !byte_buffer_printf(&glb->meshes, ",\"primitives\":[")) {
+    return false;
+  }
+
+  /* Indices of the triangles of each colour are contiguous */
+  bool const is_short = glb->vmap.count <= MaxShortIndex + 1;
+  bool first = true;
+
+  for (int colour = 0; colour < GlbNumColours; ++colour) {
+    if (ntriangles[colour] == 0) {
+      continue;
+    }
+
+    size_t const indices_start = glb->bin.len;
+    for (int p = first_prim[colour]; p <= last_prim[colour]; ++p) {
+      if (glb->prim_colour[p] != colour) {
+        continue;
+      }
+
+      _Optional const Primitive *const pp = group_get_primitive(group, p);
+      assert(pp != NULL);
+      if (!add_triangles(glb, &*pp, is_short, flags)) {
+        return false;
+      }
+    }
+
+    if (glb->material[colour] < 0) {
+      glb->colour[glb->nmaterials] = colour;
+      glb->material[colour] = glb->nmaterials++;
+    }
+
+    int const indices = glb->naccessors++;
+    if (!byte_buffer_printf(&glb->accessors,
+                            ",{\"bufferView\":%d,\"componentType\":%d,"
+                            "\"count\":%ld,\"type\":\"SCALAR\"}",
+                            glb->nviews,
+                            is_short ? ComponentTypeUnsignedShort :
+                                       ComponentTypeUnsignedInt,
+                            ntriangles[colour] * 3) ||
+        !add_view(glb, indices_start, TargetElementArrayBuffer) ||
+        !byte_buffer_printf(&glb->meshes,
+                            "%s{\"attributes\":{\"POSITION\":%d},"
+                            "\"indices\":%d,\"material\":%d}",
+                            first ? "" : ",", positions, indices,
+                            glb->material[colour])) {
+      return false;
+    }
+    first = false;
+  }
+
+  if (!byte_buffer_printf(&glb->meshes, "]}")) {
+    return false;
+  }
+
+  return add_node(glb, name, glb->nmeshes++);
+}
+
+static bool append_json_array(ByteBuffer * const json,
+                              const char * const name,
+                              const ByteBuffer * const elements)
+{
+  assert(json != NULL);
+  assert(name != NULL);
+  assert(elements != NULL);
+
+  if (elements->len == 0) {
+    /* Arrays must not be empty */
+    return true;
+  }
+
+  return byte_buffer_printf(json, ",\"%s\":[", name) &&
+         byte_buffer_append(json, &*elements->data, elements->len) &&
+         byte_buffer_printf(json, "]");
+}
+
+/* Palette entries are plain colours, like 'illum 0' in the materials
+   library, so they are unlit. */
+static bool append_materials(ByteBuffer * const json,
+                             const GlbWriter * const glb,
+                             OutputPrimitivesGetMaterialFn * const get_material,
+                             void * const arg)
+{
+  assert(json != NULL);
+  assert(glb != NULL);
+  assert(get_material != NULL);
+
+  if (glb->nmaterials == 0) {
+    return true;
+  }
+
+  if (!byte_buffer_printf(json,
+                          ",\"extensionsUsed\":[\"KHR_materials_unlit\"]"
+                          ",\"materials\":[")) {
+    return false;
+  }
+
+  for (int m = 0; m < glb->nmaterials; ++m) {
+    int const colour = glb->colour[m];
+    char name[MaxMaterialNameLen + 1];
+    int const len = get_material(name, sizeof(name), colour, arg);
+    if (len < 0 || (size_t)len >= sizeof(name)) {
+      fprintf(stderr, "Failed to get material name for colour %d\n", colour);
+      return false;
+    }
+
+    int rgb[3];
+    get_colour_components(colour, &rgb);
+
+    if (!byte_buffer_printf(json, "%s{\"name\":", m ? "," : "") ||
+        !append_json_string(json, name) ||
+        !byte_buffer_printf(json,
+                            ",\"pbrMetallicRoughness\":{"
+                            "\"baseColorFactor\":[%g,%g,%g,1],"
+                            "\"metallicFactor\":0,\"roughnessFactor\":1},"
+                            "\"extensions\":{\"KHR_materials_unlit\":{}}}",
+                            linear_component[rgb[0]],
+                            linear_component[rgb[1]],
+                            linear_component[rgb[2]])) {
+      return false;
+    }
+  }
+
+  return byte_buffer_printf(json, "]");
+}
+
+bool glb_write(const GlbWriter * const glb, FILE * const out,
+               OutputPrimitivesGetMaterialFn * const get_material,
+               void * const arg)
+{
+  assert(glb != NULL);
+  assert(out != NULL);
+  assert(get_material != NULL);
+  assert(glb->bin.len % ChunkAlignment == 0);
+
+  ByteBuffer json;
+  byte_buffer_init(&json);
+
+  bool success = byte_buffer_printf(&json,
+                   "{\"asset\":{\"version\":\"2.0\","
+                   "\"generator\":\"ApocToObj "VERSION_STRING"\"},"
+                   "\"scene\":0,\"scenes\":[{");
+
+  if (success && glb->nnodes > 0) {
+    success = byte_buffer_printf(&json, "\"nodes\":[");
+    for (int n = 0; success && n < glb->nnodes; ++n) {
+      success = byte_buffer_printf(&json, n ? ",%d" : "%d", n);
+    }
+    success = success && byte_buffer_printf(&json, "]");
+  }
+
+  success = success &&
+            byte_buffer_printf(&json, "}]") &&
+            append_json_array(&json, "nodes", &glb->nodes) &&
+            append_json_array(&json, "meshes", &glb->meshes) &&
+            append_materials(&json, glb, get_material, arg) &&
+            append_json_array(&json, "accessors", &glb->accessors) &&
+            append_json_array(&json, "bufferViews", &glb->views) &&
+            (glb->bin.len == 0 ||
+             byte_buffer_printf(&json, ",\"buffers\":[{\"byteLength\":%lu}]",
+                                (unsigned long)glb->bin.len)) &&
+            byte_buffer_printf(&json, "}");
+
+  /* The JSON chunk is padded with spaces */
+  if (success) {
+    size_t const misalign = json.len % ChunkAlignment;
+    success = byte_buffer_fill(&json, ' ',
+                               misalign ? ChunkAlignment - misalign : 0);
+  }
+
+  if (success) {
+    size_t const total = HeaderSize + ChunkHeaderSize + json.len +
+                         (glb->bin.len ? ChunkHeaderSize + glb->bin.len : 0);
+    if (total > UINT32_MAX) {
+      fputs("Output is too big for glTF\n", stderr);
+      success = false;
+    } else {
+      unsigned char header[HeaderSize + ChunkHeaderSize];
+      encode_uint32(header, GlbMagic);
+      encode_uint32(header + 4, GlbVersion);
+      encode_uint32(header + 8, (uint32_t)total);
+      encode_uint32(header + HeaderSize, (uint32_t)json.len);
+      encode_uint32(header + HeaderSize + 4, ChunkTypeJSON);
+
+      unsigned char bin_header[ChunkHeaderSize];
+      encode_uint32(bin_header, (uint32_t)glb->bin.len);
+      encode_uint32(bin_header + 4, ChunkTypeBIN);
+
+      if (fwrite(header, sizeof(header), 1, out) != 1 ||
+          fwrite(&*json.data, json.len, 1, out) != 1 ||
+          (glb->bin.len > 0 &&
+           (fwrite(bin_header, sizeof(bin_header), 1, out) != 1 ||
+            fwrite(&*glb->bin.data, glb->bin.len, 1, out) != 1))) {
+        fprintf(stderr, "Failed writing to output file: %s\n",
+                strerror(errno));
+        success = false;
+      }
+    }
+  }
+
+  byte_buffer_free(&json);
+  return success;
+}
@@ -0,0 +1,73 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Binary glTF output
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef GLB_H
+#define GLB_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* 3dObjLib headers */
+#include "Vertex.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local headers */
+#include "bytebuf.h"
+#include "meshout.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+enum {
+  GlbNumColours = 256,
+};
+
+/* Accumulates objects for a glTF binary file, which can't be written
+   until all of them are known because its header includes the total
+   length. Each object becomes a node with a mesh of indexed triangles,
+   with one primitive per colour. */
+typedef struct {
+  ByteBuffer bin;       /* vertex positions and indices */
+  ByteBuffer nodes;     /* JSON for the elements of each array */
+  ByteBuffer meshes;
+  ByteBuffer accessors;
+  ByteBuffer views;
+  int nnodes, nmeshes, naccessors, nviews;
+  int material[GlbNumColours]; /* material for each colour, or -1 */
+  int colour[GlbNumColours];   /* colour of each material */
+  int nmaterials;
+
+  /* Workspace for the object being added */
+  VertexMap vmap;
+  _Optional int *prim_colour; /* colour of each primitive, or -1 */
+  size_t prim_colour_size;
+} GlbWriter;
+
+void glb_init(GlbWriter *glb);
+void glb_free(GlbWriter *glb);
+
+/* Forgets all nodes, meshes and materials, e.g. before converting another
+   file. */
+void glb_reset(GlbWriter *glb);
+
+/* Adds an object as a node named name, with polygons split into triangles
+   which are grouped by colour. get_colour, if not null, is called for each
+   primitive in order to override its colour. */
+bool glb_add_object(GlbWriter *glb, const char *name,
+                    const VertexArray *varray, const Group *group,
+                    _Optional OutputPrimitivesGetColourFn *get_colour,
+                    void *arg, unsigned int flags);
+
+/* Writes the JSON and binary chunks for every object added since the last
+   reset, with a material named by get_material for each colour used. */
+bool glb_write(const GlbWriter *glb, FILE *out,
+               OutputPrimitivesGetMaterialFn *get_material, void *arg);
+
+#endif /* GLB_H */
@@ -0,0 +1,319 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Bounded pool of worker threads
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(USE_PTHREADS)
+#include <pthread.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+/* Local header files */
+#include "jobs.h"
+#include "misc.h"
+
+typedef struct {
+  JobsFn *fn;
+  void *arg;
+  int njobs;
+  int next_job;
+  bool stopped; /* a job failed, so no more should be started */
+#if defined(USE_PTHREADS)
+  pthread_mutex_t mutex;
+#elif defined(_WIN32)
+  CRITICAL_SECTION mutex;
+#endif
+} JobQueue;
+
+static int claim_job(JobQueue *const queue, bool const stop)
+{
+  assert(queue != NULL);
+
+#if defined(USE_PTHREADS)
+  pthread_mutex_lock(&queue->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&queue->mutex);
+#endif
+
+  if (stop) {
+    queue->stopped = true;
+  }
+
+  int job = -1;
+  if (!queue->stopped && queue->next_job < queue->njobs) {
+    job = queue->next_job++;
+  }
+
+#if defined(USE_PTHREADS)
+  pthread_mutex_unlock(&queue->mutex);
+#elif defined(_WIN32)
+  LeaveCriticalSection(&queue->mutex);
+#endif
+
+  return job;
+}
+
+static void run_jobs(JobQueue *const queue)
+{
+  assert(queue != NULL);
+  bool success = true;
+  for (int job = claim_job(queue, false); job >= 0;
+       job = claim_job(queue, !success)) {
+    success = queue->fn(queue->arg, job);
+  }
+}
+
+#if defined(USE_PTHREADS) || defined(_WIN32)
+enum {
+  MaxThreadIds = JobsMaxThreads * 4, /* more are numbered in sequence */
+};
+
+/* Each worker is given the smallest number not in use by another thread
+   when it is started, which it keeps in thread-local storage. */
+static bool id_in_use[MaxThreadIds]; /* indexed by thread number - 1 */
+static unsigned long last_extra_id;
+
+#if defined(USE_PTHREADS)
+static pthread_once_t id_once = PTHREAD_ONCE_INIT;
+static pthread_key_t id_key;
+static bool id_key_ok;
+static pthread_mutex_t id_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void make_id_key(void)
+{
+  id_key_ok = !pthread_key_create(&id_key, NULL);
+}
+#else
+static INIT_ONCE id_once = INIT_ONCE_STATIC_INIT;
+static DWORD id_index = TLS_OUT_OF_INDEXES;
+static SRWLOCK id_mutex = SRWLOCK_INIT;
+
+static BOOL CALLBACK make_id_index(PINIT_ONCE const once, PVOID const param,
+                                   PVOID *const context)
+{
+  (void)once;
+  (void)param;
+  (void)context;
+  id_index = TlsAlloc();
+  return TRUE;
+}
+#endif
+
+static void lock_ids(void)
+{
+#if defined(USE_PTHREADS)
+  pthread_mutex_lock(&id_mutex);
+#else
+  AcquireSRWLockExclusive(&id_mutex);
+#endif
+}
+
+static void unlock_ids(void)
+{
+#if defined(USE_PTHREADS)
+  pthread_mutex_unlock(&id_mutex);
+#else
+  ReleaseSRWLockExclusive(&id_mutex);
+#endif
+}
+
+/* Gets an unused thread number, starting from 1. */
+static unsigned long claim_thread_id(void)
+{
+  lock_ids();
+  unsigned long id = 0;
+  for (size_t i = 0; id == 0 && i < ARRAY_SIZE(id_in_use); ++i) {
+    if (!id_in_use[i]) {
+      id_in_use[i] = true;
+      id = (unsigned long)i + 1;
+    }
+  }
+  if (id == 0) {
+    id = MaxThreadIds + ++last_extra_id;
+  }
+  unlock_ids();
+  return id;
+}
+
+/* Allows a thread number to be reused once its thread has finished. */
+static void release_thread_id(unsigned long const id)
+{
+  assert(id > 0);
+  if (id <= MaxThreadIds) {
+    lock_ids();
+    assert(id_in_use[id - 1]);
+    id_in_use[id - 1] = false;
+    unlock_ids();
+  }
+}
+
+/* Gets the number of the calling thread, or 0 if it has none. If
+   thread-local storage isn't available then every thread is number 1. */
+static unsigned long get_thread_id(void)
+{
+#if defined(USE_PTHREADS)
+  pthread_once(&id_once, make_id_key);
+  return id_key_ok ? (unsigned long)(uintptr_t)pthread_getspecific(id_key) :
+                     1;
+#else
+  InitOnceExecuteOnce(&id_once, make_id_index, NULL, NULL);
+  return id_index != TLS_OUT_OF_INDEXES ?
+         (unsigned long)(uintptr_t)TlsGetValue(id_index) : 1;
+#endif
+}
+
+static void set_thread_id(unsigned long const id)
+{
+  assert(id > 0);
+#if defined(USE_PTHREADS)
+  pthread_once(&id_once, make_id_key);
+  if (id_key_ok) {
+    (void)pthread_setspecific(id_key, (void *)(uintptr_t)id);
+  }
+#else
+  InitOnceExecuteOnce(&id_once, make_id_index, NULL, NULL);
+  if (id_index != TLS_OUT_OF_INDEXES) {
+    (void)TlsSetValue(id_index, (LPVOID)(uintptr_t)id);
+  }
+#endif
+}
+
+typedef struct {
+  JobQueue *queue;
+  unsigned long id;
+} Worker;
+
+#if defined(USE_PTHREADS)
+static void *worker(void *const arg)
+{
+  const Worker *const w = arg;
+  set_thread_id(w->id);
+  run_jobs(w->queue);
+  return NULL;
+}
+#else
+static DWORD WINAPI worker(LPVOID const arg)
+{
+  const Worker *const w = arg;
+  set_thread_id(w->id);
+  run_jobs(w->queue);
+  return 0;
+}
+#endif
+#endif
+
+bool jobs_run(int nthreads, int const njobs, JobsFn *const fn,
+              void *const arg)
+{
+  assert(nthreads >= 1);
+  assert(njobs >= 0);
+  assert(fn != NULL);
+
+  JobQueue queue = {
+    .fn = fn,
+    .arg = arg,
+    .njobs = njobs,
+    .next_job = 0,
+    .stopped = false,
+  };
+
+  if (nthreads > njobs) {
+    nthreads = njobs;
+  }
+  if (nthreads > JobsMaxThreads) {
+    nthreads = JobsMaxThreads;
+  }
+
+  int nstarted = 0;
+
+#if defined(USE_PTHREADS)
+  pthread_t threads[JobsMaxThreads];
+  Worker workers[JobsMaxThreads];
+  pthread_mutex_init(&queue.mutex, NULL);
+
+  /* The calling thread is one of the workers */
+  for (; nstarted < nthreads - 1; ++nstarted) {
+    workers[nstarted] = (Worker){&queue, claim_thread_id()};
+    if (pthread_create(&threads[nstarted], NULL, worker,
+                       &workers[nstarted])) {
+      release_thread_id(workers[nstarted].id);
+      break;
+    }
+  }
+
+  run_jobs(&queue);
+
+  for (int t = 0; t < nstarted; ++t) {
+    pthread_join(threads[t], NULL);
+    release_thread_id(workers[t].id);
+  }
+
+  pthread_mutex_destroy(&queue.mutex);
+
+#elif defined(_WIN32)
+  HANDLE threads[JobsMaxThreads];
+  Worker workers[JobsMaxThreads];
+  InitializeCriticalSection(&queue.mutex);
+
+  for (; nstarted < nthreads - 1; ++nstarted) {
+    workers[nstarted] = (Worker){&queue, claim_thread_id()};
+    threads[nstarted] = CreateThread(NULL, 0, worker, &workers[nstarted], 0,
+                                     NULL);
+    if (threads[nstarted] == NULL) {
+      release_thread_id(workers[nstarted].id);
+      break;
+    }
+  }
+
+  run_jobs(&queue);
+
+  for (int t = 0; t < nstarted; ++t) {
+    WaitForSingleObject(threads[t], INFINITE);
+    CloseHandle(threads[t]);
+    release_thread_id(workers[t].id);
+  }
+
+  DeleteCriticalSection(&queue.mutex);
+
+#else
+  run_jobs(&queue);
+#endif
+
+  return nthreads <= 1 || nstarted == nthreads - 1;
+}
+
+unsigned long jobs_thread_id(void)
+{
+#if defined(USE_PTHREADS) || defined(_WIN32)
+  unsigned long id = get_thread_id();
+  if (id == 0) {
+    /* A thread which isn't one of the workers, e.g. the main thread */
+    id = claim_thread_id();
+    set_thread_id(id);
+  }
+  return id;
+#else
+  return 1;
+#endif
+}
@@ -0,0 +1,36 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Bounded pool of worker threads
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+
+enum {
+  JobsMaxThreads = 256,
+};
+
+/* Function called to do job number 'job' (0 <= job < njobs). It may be
+   called concurrently from different threads with different job numbers.
+   Returning false stops any jobs that haven't yet been started. */
+typedef bool JobsFn(void *arg, int job);
+
+/* Runs njobs jobs on up to nthreads worker threads and waits for all of
+   them to finish. Jobs are started in ascending order of job number, so
+   every job before one that failed will have been run.
+   If threads aren't supported (or can't be created) then the remaining
+   jobs are run on the calling thread. Returns false if fewer threads than
+   requested were started. */
+bool jobs_run(int nthreads, int njobs, JobsFn *fn, void *arg);
+
+/* Gets a small number identifying the calling thread, which is the same
+   for every call on that thread. Workers are numbered by jobs_run(), and
+   other threads on their first call, starting from 1. Numbers of workers
+   are reused once they have finished. */
+unsigned long jobs_thread_id(void);
+
+#endif /* JOBS_H */
@@ -0,0 +1,187 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Whole-file input mapping
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifdef USE_MMAP
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#ifdef USE_MMAP
+/* POSIX header files */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* Local header files */
+#include "mapfile.h"
+#include "misc.h"
+
+enum {
+  ReadChunkSize = 64 * 1024,
+};
+
+#ifdef USE_MMAP
+static bool map_file(MappedFile * const mf, FILE * const f)
+{
+  assert(mf != NULL);
+  assert(f != NULL);
+
+  int const fd = fileno(f);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (uintmax_t)st.st_size > SIZE_MAX) {
+    return false;
+  }
+
+  size_t const size = (size_t)st.st_size;
+  void *const addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    DEBUGF("Failed to map input file: %s\n", strerror(errno));
+    return false;
+  }
+
+  mf->data = addr;
+  mf->size = size;
+  mf->mapped = true;
+  mf->mtime = st.st_mtime;
+  return true;
+}
+#endif
+
+bool mapped_file_read_all(MappedFileReadFn * const read, void * const arg,
+                          _Optional unsigned char ** const data,
+                          size_t * const len, size_t * const size)
+{
+  assert(read != NULL);
+  assert(data != NULL);
+  assert(len != NULL);
+  assert(size != NULL);
+  assert(*len <= *size);
+
+  long int n;
+  do {
+    if (*size - *len < ReadChunkSize) {
+      if (*size > SIZE_MAX / 2) {
+        fputs("Input is too big\n", stderr);
+        return false;
+      }
+      size_t const new_size = *size ? *size * 2 : ReadChunkSize;
+      _Optional unsigned char *const new_data = realloc(*data, new_size);
+      if (new_data == NULL) {
+        fputs("Failed to allocate memory for input\n", stderr);
+        return false;
+      }
+      *data = new_data;
+      *size = new_size;
+    }
+
+    size_t const max = *size - *len < LONG_MAX ? *size - *len : LONG_MAX;
+    n = read(&**data + *len, max, arg);
+    if (n < 0 || (unsigned long)n > max) {
+      fputs("Failed to read input\n", stderr);
+      return false;
+    }
+    *len += (size_t)n;
+  } while (n > 0);
+
+  return true;
+}
+
+static long int read_file(void * const buffer, size_t const size,
+                          void * const arg)
+{
+  FILE *const f = arg;
+  assert(buffer != NULL);
+  assert(f != NULL);
+
+  if (feof(f)) {
+    return 0;
+  }
+  size_t const n = fread(buffer, 1, size, f);
+  return (n == 0 && ferror(f)) ? -1 : (long int)n;
+}
+
+static bool load_file(MappedFile * const mf, FILE * const f)
+{
+  assert(mf != NULL);
+  assert(f != NULL);
+
+  _Optional unsigned char *buf = NULL;
+  size_t size = 0, buf_size = 0;
+
+  if (!mapped_file_read_all(read_file, f, &buf, &size, &buf_size)) {
+    free(buf);
+    return false;
+  }
+
+  mf->data = buf;
+  mf->size = size;
+  mf->mapped = false;
+  return true;
+}
+
+bool mapped_file_init(MappedFile * const mf, FILE * const f)
+{
+  assert(mf != NULL);
+  assert(f != NULL);
+
+  mf->data = NULL;
+  mf->size = 0;
+  mf->mapped = false;
+  mf->mtime = (time_t)-1;
+
+#ifdef USE_MMAP
+  if (map_file(mf, f)) {
+    return true;
+  }
+#endif
+
+  return load_file(mf, f);
+}
+
+void mapped_file_destroy(MappedFile * const mf)
+{
+  assert(mf != NULL);
+
+#ifdef USE_MMAP
+  if (mf->mapped) {
+    munmap((void *)mf->data, mf->size);
+    mf->data = NULL;
+    return;
+  }
+#endif
+
+  free((void *)mf->data);
+  mf->data = NULL;
+}
@@ -0,0 +1,46 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Whole-file input mapping
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef struct {
+  _Optional const unsigned char *data;
+  size_t size;
+  bool mapped; /* true if data is a file mapping rather than a heap copy */
+  time_t mtime; /* modification time of a mapped file, else (time_t)-1 */
+} MappedFile;
+
+/* Supplies up to size bytes of a stream. Returns the no. of bytes
+   supplied (0 at the end of the stream) or a negative value on error. */
+typedef long int MappedFileReadFn(void *buffer, size_t size, void *arg);
+
+/* Reads the rest of a stream onto the end of a heap block of *len bytes
+   (of which *size are allocated), doubling its size as needed. The block
+   is still owned by the caller if this fails. */
+bool mapped_file_read_all(MappedFileReadFn *read, void *arg,
+                          _Optional unsigned char **data, size_t *len,
+                          size_t *size);
+
+/* Makes the whole content of a stream available in memory. Regular files
+   are mapped read-only where supported (USE_MMAP); otherwise, or for pipes
+   such as stdin, the stream is read into a heap block. The stream may be
+   closed afterwards without invalidating the data. */
+bool mapped_file_init(MappedFile *mf, FILE *f);
+
+void mapped_file_destroy(MappedFile *mf);
+
+#endif /* MAPFILE_H */
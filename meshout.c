@@ -0,0 +1,241 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Mesh data for binary output formats
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+
+/* Local header files */
+#include "meshout.h"
+#include "flags.h"
+#include "misc.h"
+
+enum {
+  MinTableSize = 64,
+};
+
+void vertex_map_init(VertexMap * const vmap)
+{
+  assert(vmap != NULL);
+  vmap->map = NULL;
+  vmap->map_size = 0;
+  vmap->table = NULL;
+  vmap->table_size = 0;
+  vmap->nentries = 0;
+  vmap->count = 0;
+}
+
+void vertex_map_free(VertexMap * const vmap)
+{
+  assert(vmap != NULL);
+  free(vmap->map);
+  free(vmap->table);
+  vertex_map_init(vmap);
+}
+
+bool grow_int_array(_Optional int **const array, size_t *const size,
+                    size_t const n)
+{
+  assert(array != NULL);
+  assert(size != NULL);
+
+  if (n <= *size) {
+    return true;
+  }
+
+  if (n > SIZE_MAX / sizeof(**array)) {
+    fputs("Too many elements for output\n", stderr);
+    return false;
+  }
+
+  _Optional int *const new_array = realloc(*array, n * sizeof(**array));
+  if (new_array == NULL) {
+    fputs("Failed to allocate memory for output\n", stderr);
+    return false;
+  }
+  *array = new_array;
+  *size = n;
+  return true;
+}
+
+bool vertex_map_start(VertexMap * const vmap,
+                      const VertexArray * const varray,
+                      const unsigned int flags)
+{
+  assert(vmap != NULL);
+  assert(varray != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int const nvertices = vertex_array_get_num_vertices(varray);
+  assert(nvertices >= 0);
+
+  vmap->count = 0;
+  vmap->nentries = 0;
+
+  if (!(flags & FLAGS_DUPLICATE)) {
+    size_t nentries = MinTableSize;
+    while (nentries < (size_t)nvertices * 2) {
+      nentries *= 2;
+    }
+    if (!grow_int_array(&vmap->table, &vmap->table_size, nentries)) {
+      return false;
+    }
+    memset(&*vmap->table, 0, nentries * sizeof(*vmap->table));
+    vmap->nentries = nentries;
+  }
+
+  if (!grow_int_array(&vmap->map, &vmap->map_size, (size_t)nvertices)) {
+    return false;
+  }
+
+  for (int v = 0; v < nvertices; ++v) {
+    vmap->map[v] = -1;
+  }
+  return true;
+}
+
+/* Mixes the bits of the coordinates. Equal values with different
+   representations (e.g. 0 and -0) merely aren't merged. */
+static size_t hash_coords(Coord (*const coords)[3])
+{
+  assert(coords != NULL);
+
+  uint64_t hash = 0;
+  for (size_t i = 0; i < ARRAY_SIZE(*coords); ++i) {
+    uint64_t bits = 0;
+    memcpy(&bits, &(*coords)[i], sizeof((*coords)[i]) < sizeof(bits) ?
+                                 sizeof((*coords)[i]) : sizeof(bits));
+    hash = (hash ^ bits) * UINT64_C(0x9e3779b97f4a7c15);
+  }
+
+  /* Whole numbers only have high bits set, so mix those into the low bits
+     used to index a table */
+  hash ^= hash >> 32;
+  hash *= UINT64_C(0xff51afd7ed558ccd);
+  return (size_t)(hash ^ (hash >> 32));
+}
+
+int vertex_table_find(int * const table, size_t const nentries,
+                      const VertexArray * const varray, int const v,
+                      Coord (*const coords)[3])
+{
+  assert(table != NULL);
+  assert(nentries > 0);
+  assert((nentries & (nentries - 1)) == 0);
+  assert(varray != NULL);
+  assert(v >= 0);
+  assert(coords != NULL);
+
+  size_t const mask = nentries - 1;
+  for (size_t i = hash_coords(coords) & mask; ; i = (i + 1) & mask) {
+    int *const entry = &table[i];
+    if (*entry == 0) {
+      *entry = v + 1;
+      return v;
+    }
+
+    _Optional Coord (*const other)[3] =
+      vertex_array_get_coords(varray, *entry - 1);
+    if (other && (*other)[0] == (*coords)[0] &&
+        (*other)[1] == (*coords)[1] && (*other)[2] == (*coords)[2]) {
+      return *entry - 1;
+    }
+  }
+}
+
+int vertex_map_add(VertexMap * const vmap, const VertexArray * const varray,
+                   int const v, bool * const added)
+{
+  assert(vmap != NULL);
+  assert(vmap->map != NULL);
+  assert(varray != NULL);
+  assert(v >= 0);
+  assert((size_t)v < vmap->map_size);
+  assert(added != NULL);
+
+  *added = false;
+  if (vmap->map[v] >= 0) {
+    return vmap->map[v];
+  }
+
+  _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, v);
+  if (coords == NULL) {
+    fprintf(stderr, "Bad vertex %d for output\n", v);
+    return -1;
+  }
+
+  if (vmap->nentries > 0) {
+    assert(vmap->table != NULL);
+    int const first = vertex_table_find(&*vmap->table, vmap->nentries,
+                                        varray, v, &*coords);
+    if (first != v) {
+      vmap->map[v] = vmap->map[first];
+      return vmap->map[v];
+    }
+  }
+
+  *added = true;
+  vmap->map[v] = vmap->count++;
+  return vmap->map[v];
+}
+
+int vertex_map_get(const VertexMap * const vmap, int const v)
+{
+  assert(vmap != NULL);
+  assert(vmap->map != NULL);
+  assert(v >= 0);
+  assert((size_t)v < vmap->map_size);
+  assert(vmap->map[v] >= 0);
+  return vmap->map[v];
+}
+
+void get_triangle(int const nsides, int const t, const unsigned int flags,
+                  int (*const sides)[3])
+{
+  assert(nsides >= 3);
+  assert(t >= 0);
+  assert(t < nsides - 2);
+  assert(!(flags & ~FLAGS_ALL));
+  assert(sides != NULL);
+
+  if (flags & FLAGS_TRIANGLE_STRIPS) {
+    /* Sides in strip order are 0, 1, n-1, 2, n-2, ... and every other
+       triangle is reversed to keep the winding order */
+    for (int k = 0; k < 3; ++k) {
+      int const j = t + k;
+      (*sides)[k] = (j == 0) ? 0 : (j % 2) ? (j + 1) / 2 : nsides - j / 2;
+    }
+    if (t % 2) {
+      int const tmp = (*sides)[0];
+      (*sides)[0] = (*sides)[1];
+      (*sides)[1] = tmp;
+    }
+  } else {
+    (*sides)[0] = 0;
+    (*sides)[1] = t + 1;
+    (*sides)[2] = t + 2;
+  }
+}
@@ -0,0 +1,63 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Mesh data for binary output formats
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef MESHOUT_H
+#define MESHOUT_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Makes an array of ints big enough for n elements, keeping its contents.
+   *size is the no. of elements allocated. */
+bool grow_int_array(_Optional int **array, size_t *size, size_t n);
+
+/* Finds a vertex with the same coordinates as vertex v (which has coords)
+   in a hash table of vertex numbers + 1, where 0 means free, or else adds
+   v to the table. nentries must be a power of two bigger than the no. of
+   vertices to be added. Returns the number of the vertex found, or v. */
+int vertex_table_find(int *table, size_t nentries, const VertexArray *varray,
+                      int v, Coord (*coords)[3]);
+
+/* Numbers the vertices of one object in order of first use, giving
+   duplicate vertices the same number unless they are to be kept. */
+typedef struct {
+  _Optional int *map;   /* output number of each vertex, or -1 */
+  size_t map_size;
+  _Optional int *table; /* hash table of vertex numbers + 1 */
+  size_t table_size;
+  size_t nentries;      /* a power of two, or 0 to keep duplicates */
+  int count;            /* no. of vertices numbered */
+} VertexMap;
+
+void vertex_map_init(VertexMap *vmap);
+void vertex_map_free(VertexMap *vmap);
+
+/* Forgets all vertices before numbering those of another object. */
+bool vertex_map_start(VertexMap *vmap, const VertexArray *varray,
+                      unsigned int flags);
+
+/* Gets the output number of a vertex, numbering it if necessary, in which
+   case *added is set to true. Returns -1 on error. */
+int vertex_map_add(VertexMap *vmap, const VertexArray *varray, int v,
+                   bool *added);
+
+/* Gets the output number of a vertex which was already added. */
+int vertex_map_get(const VertexMap *vmap, int v);
+
+/* Gets the sides of triangle t of a convex polygon split into a fan (or a
+   strip, according to flags), with the same winding order. */
+void get_triangle(int nsides, int t, unsigned int flags, int (*sides)[3]);
+
+#endif /* MESHOUT_H */
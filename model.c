@@ -0,0 +1,183 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Compact model of all objects in a file
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Local header files */
+#include "model.h"
+#include "misc.h"
+
+enum {
+  MinVertices = 1024,
+  MinPrimitives = 1024,
+};
+
+void apoc_model_init(ApocModel * const model)
+{
+  assert(model != NULL);
+
+  model->flats = false;
+  model->nobjects = 0;
+  model->objects = NULL;
+  model->nvertices = model->vertices_size = 0;
+  model->x = model->y = model->z = NULL;
+  model->nprimitives = model->primitives_size = 0;
+  model->nsides = model->sides = model->colours = NULL;
+}
+
+void apoc_model_free(ApocModel * const model)
+{
+  assert(model != NULL);
+
+  free(model->objects);
+  free(model->x);
+  free(model->y);
+  free(model->z);
+  free(model->nsides);
+  free(model->sides);
+  free(model->colours);
+  apoc_model_init(model);
+}
+
+/* Resizes one of the arrays of a model, keeping its contents. Returns
+   NULL (without freeing the array) on failure. */
+static _Optional void *resize(_Optional void *const array, size_t const n,
+                              size_t const size)
+{
+  assert(size > 0);
+
+  if (n > SIZE_MAX / size) {
+    fputs("Too much data for model\n", stderr);
+    return NULL;
+  }
+
+  _Optional void *const new_array = realloc(array, n * size);
+  if (new_array == NULL) {
+    fputs("Failed to allocate memory for model\n", stderr);
+  }
+  return new_array;
+}
+
+bool apoc_model_reset(ApocModel * const model, bool const flats,
+                      int const nobjects)
+{
+  assert(model != NULL);
+  assert(nobjects >= 0);
+
+  model->nvertices = 0;
+  model->nprimitives = 0;
+
+  if (model->objects == NULL || nobjects > model->nobjects) {
+    _Optional ApocModelObject *const objects = resize(model->objects,
+      nobjects > 0 ? (size_t)nobjects : 1, sizeof(*objects));
+    if (objects == NULL) {
+      return false;
+    }
+    model->objects = objects;
+  }
+
+  model->flats = flats;
+  model->nobjects = nobjects;
+  return true;
+}
+
+bool apoc_model_add_vertex(ApocModel * const model, int32_t const x,
+                           int32_t const y, int32_t const z)
+{
+  assert(model != NULL);
+
+  if (model->nvertices == model->vertices_size) {
+    size_t const n = model->vertices_size ? model->vertices_size * 2 :
+                                            MinVertices;
+    _Optional int32_t *const new_x = resize(model->x, n, sizeof(*new_x));
+    if (new_x == NULL) {
+      return false;
+    }
+    model->x = new_x;
+
+    _Optional int32_t *const new_y = resize(model->y, n, sizeof(*new_y));
+    if (new_y == NULL) {
+      return false;
+    }
+    model->y = new_y;
+
+    _Optional int32_t *const new_z = resize(model->z, n, sizeof(*new_z));
+    if (new_z == NULL) {
+      return false;
+    }
+    model->z = new_z;
+    model->vertices_size = n;
+  }
+
+  size_t const v = model->nvertices++;
+  model->x[v] = x;
+  model->y[v] = y;
+  model->z[v] = z;
+  return true;
+}
+
+bool apoc_model_add_primitive(ApocModel * const model, int const nsides,
+                              const uint8_t * const sides,
+                              uint8_t const colour)
+{
+  assert(model != NULL);
+  assert(nsides > 0);
+  assert(nsides <= ApocModelMaxSides);
+  assert(sides != NULL);
+
+  if (model->nprimitives == model->primitives_size) {
+    size_t const n = model->primitives_size ?
+                     model->primitives_size * 2 : MinPrimitives;
+    _Optional uint8_t *const new_nsides =
+      resize(model->nsides, n, sizeof(*new_nsides));
+    if (new_nsides == NULL) {
+      return false;
+    }
+    model->nsides = new_nsides;
+
+    _Optional uint8_t *const new_sides =
+      resize(model->sides, n, ApocModelMaxSides);
+    if (new_sides == NULL) {
+      return false;
+    }
+    model->sides = new_sides;
+
+    _Optional uint8_t *const new_colours =
+      resize(model->colours, n, sizeof(*new_colours));
+    if (new_colours == NULL) {
+      return false;
+    }
+    model->colours = new_colours;
+    model->primitives_size = n;
+  }
+
+  size_t const p = model->nprimitives++;
+  uint8_t *const dst = &model->sides[p * ApocModelMaxSides];
+  model->nsides[p] = (uint8_t)nsides;
+  memcpy(dst, sides, (size_t)nsides);
+  memset(dst + nsides, 0, ApocModelMaxSides - (size_t)nsides);
+  model->colours[p] = colour;
+  return true;
+}
@@ -0,0 +1,64 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Compact model of all objects in a file
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef MODEL_H
+#define MODEL_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+enum {
+  ApocModelMaxSides = 7,
+};
+
+/* Where an object's data is in the arrays of a model. Objects with the
+   same file position share their data. */
+typedef struct {
+  long int file_pos;        /* position of the object header */
+  long int size;            /* no. of bytes parsed */
+  uint32_t first_vertex;
+  uint32_t nvertices;
+  uint32_t first_primitive;
+  uint32_t nprimitives;     /* 0 for a flat, whose vertices are its sides */
+} ApocModelObject;
+
+/* Holds every object in a file as parsed, using the same integer types as
+   the file but in separate arrays for each field. Vertex numbers in sides
+   are relative to the object's first vertex. */
+typedef struct {
+  bool flats;
+  int nobjects;
+  _Optional ApocModelObject *objects;
+
+  size_t nvertices, vertices_size;
+  _Optional int32_t *x, *y, *z; /* z is 0 for flats */
+
+  size_t nprimitives, primitives_size;
+  _Optional uint8_t *nsides;
+  _Optional uint8_t *sides;     /* ApocModelMaxSides per primitive */
+  _Optional uint8_t *colours;
+} ApocModel;
+
+void apoc_model_init(ApocModel *model);
+void apoc_model_free(ApocModel *model);
+
+/* Forgets all vertices and primitives and makes room for the given no. of
+   objects, whose entries must then be filled in by the caller. */
+bool apoc_model_reset(ApocModel *model, bool flats, int nobjects);
+
+bool apoc_model_add_vertex(ApocModel *model, int32_t x, int32_t y,
+                           int32_t z);
+
+bool apoc_model_add_primitive(ApocModel *model, int nsides,
+                              const uint8_t *sides, uint8_t colour);
+
+#endif /* MODEL_H */
@@ -20,68 +20,88 @@
 
 /* ISO library header files */
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
 
 /* Local header files */
 #include "names.h"
 #include "misc.h"
 
-const char *get_flat_name(const int index)
+static const struct {
+  int first;
+  int last;
+  const char *string;
+} names[] = {
+  /* Although other object meshes are recognizable, these are
+     the only named targets in 'Apocalypse'. */
+  {   1,   1, "guard_tower_1"},
+  {   4,   5, "guard_tower_top"},
+  {   6,   6, "guard_tower_2"},
+  {  14,  14, "processing_factory"},
+  {  15,   7, "obelisk_1"},
+  {  22,  22, "saucer_1"}, /* has missing vertex data */
+  {  23,  23, "simtaal_quak_1"},
+  {  24,  24, "simtaal_quak_2"},
+  {  25,  25, "simtaal_quak_3"},
+  {  26,  26, "snail_rider"},
+  {  31,  31, "saucer_2"},
+  {  36,  35, "rakonan_barftub"},
+  {  40,  42, "ground_wasp"},
+  {  44,  46, "tilexu_floater"},
+  {  55,  55, "silicon_vat"},
+  {  56,  56, "static_release"},
+  {  57,  57, "ground_scanner"},
+  {  58,  61, "pumping_station"},
+  {  62,  65, "seismic_hammer"},
+  {  66,  69, "krypton_breather"},
+  {  70,  70, "ground_transport_1"},
+  {  71,  71, "ground_transport_2"},
+  {  72,  74, "wind_generator_1"},
+  {  75,  78, "wind_generator_2"},
+  {  80,  87, "rakonan_gomjabba"},
+  {  88,  95, "proton_flapper"},
+  {  96, 103, "electron_grinder"},
+  { 104, 111, "wave_generator"},
+  { 112, 119, "postal_teleport"},
+  { 120, 127, "climatic_ticker"},
+  { 128, 135, "weirding_flasher"},
+  { 136, 143, "aldebran_linkbat"},
+  { 144, 151, "argon_storehouse"},
+  { 152, 159, "thermal_riser"},
+  { 166, 167, "obelisk_2"},
+  { 181, 187, "snailherd"},
+  { 192, 199, "lhaktal_gourd"},
+};
+
+/* Indices into names[] in strcmp order, for bsearch. These are sorted
+   when first needed, so names[] can be edited in any order. */
+static unsigned char by_name[ARRAY_SIZE(names)];
+static bool by_name_sorted;
+
+/* Fails to compile if an index into names[] doesn't fit in by_name[] */
+typedef char by_name_size_check[
+  ARRAY_SIZE(names) <= UCHAR_MAX + 1 ? 1 : -1];
+
+const char *get_flat_name(const int index, char *const buffer,
+                          size_t const buffer_size)
 {
-  static char buffer[64];
-  sprintf(buffer, "flat_%d", index);
+  assert(buffer != NULL);
+  assert(buffer_size >= NameBufferSize);
+  snprintf(buffer, buffer_size, "flat_%d", index);
   return buffer;
 }
 
-const char *get_obj_name(const int index)
+const char *get_obj_name(const int index, char *const buffer,
+                         size_t const buffer_size)
 {
-  static char buffer[64];
-  static struct {
-    int first;
-    int last;
-    const char *string;
-  } names[] = {
-    /* Although other object meshes are recognizable, these are
-       the only named targets in 'Apocalypse'. */
-    {   1,   1, "guard_tower_1"},
-    {   4,   5, "guard_tower_top"},
-    {   6,   6, "guard_tower_2"},
-    {  14,  14, "processing_factory"},
-    {  15,   7, "obelisk_1"},
-    {  22,  22, "saucer_1"}, /* has missing vertex data */
-    {  23,  23, "simtaal_quak_1"},
-    {  24,  24, "simtaal_quak_2"},
-    {  25,  25, "simtaal_quak_3"},
-    {  26,  26, "snail_rider"},
-    {  31,  31, "saucer_2"},
-    {  36,  35, "rakonan_barftub"},
-    {  40,  42, "ground_wasp"},
-    {  44,  46, "tilexu_floater"},
-    {  55,  55, "silicon_vat"},
-    {  56,  56, "static_release"},
-    {  57,  57, "ground_scanner"},
-    {  58,  61, "pumping_station"},
-    {  62,  65, "seismic_hammer"},
-    {  66,  69, "krypton_breather"},
-    {  70,  70, "ground_transport_1"},
-    {  71,  71, "ground_transport_2"},
-    {  72,  74, "wind_generator_1"},
-    {  75,  78, "wind_generator_2"},
-    {  80,  87, "rakonan_gomjabba"},
-    {  88,  95, "proton_flapper"},
-    {  96, 103, "electron_grinder"},
-    { 104, 111, "wave_generator"},
-    { 112, 119, "postal_teleport"},
-    { 120, 127, "climatic_ticker"},
-    { 128, 135, "weirding_flasher"},
-    { 136, 143, "aldebran_linkbat"},
-    { 144, 151, "argon_storehouse"},
-    { 152, 159, "thermal_riser"},
-    { 166, 167, "obelisk_2"},
-    { 181, 187, "snailherd"},
-    { 192, 199, "lhaktal_gourd"},
-  };
   _Optional const char *n = NULL;
   assert(index >= 0);
+  assert(buffer != NULL);
+  assert(buffer_size >= NameBufferSize);
 
   for (size_t i = 0; (n == NULL) && (i < ARRAY_SIZE(names)); ++i) {
     if ((names[i].first == names[i].last) && (index == names[i].first)) {
@@ -98,16 +118,160 @@ const char *get_obj_name(const int index)
         frame = index - names[i].first;
       }
       if (frame >= 0) {
-        sprintf(buffer, "%s_f%d", names[i].string, frame);
+        snprintf(buffer, buffer_size, "%s_f%d", names[i].string, frame);
         n = buffer;
       }
     }
   }
 
   if (n == NULL) {
-    sprintf(buffer, "apocalypse_%d", index);
+    snprintf(buffer, buffer_size, "apocalypse_%d", index);
     n = buffer;
   }
 
   return &*n;
 }
+
+int get_obj_model(const int index)
+{
+  assert(index >= 0);
+
+  for (size_t i = 0; i < ARRAY_SIZE(names); ++i) {
+    if (names[i].first == names[i].last) {
+      continue;
+    }
+    if ((names[i].first > names[i].last &&
+         (index == names[i].first || index == names[i].last)) ||
+        (index >= names[i].first && index <= names[i].last)) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static int compare_name(const void *const key, const void *const element)
+{
+  const char *const string = key;
+  const unsigned char *const i = element;
+  assert(string != NULL);
+  assert(i != NULL);
+  assert(*i < ARRAY_SIZE(names));
+  return strcmp(string, names[*i].string);
+}
+
+static int compare_names(const void *const a, const void *const b)
+{
+  const unsigned char *const i = a, *const j = b;
+  assert(i != NULL);
+  assert(j != NULL);
+  assert(*i < ARRAY_SIZE(names));
+  assert(*j < ARRAY_SIZE(names));
+  return strcmp(names[*i].string, names[*j].string);
+}
+
+/* Not thread-safe, but names are only looked up before any jobs start. */
+static void sort_names(void)
+{
+  if (by_name_sorted) {
+    return;
+  }
+  for (size_t i = 0; i < ARRAY_SIZE(by_name); ++i) {
+    by_name[i] = (unsigned char)i;
+  }
+  qsort(by_name, ARRAY_SIZE(by_name), sizeof(by_name[0]), compare_names);
+  by_name_sorted = true;
+}
+
+static int find_name(const char *const string)
+{
+  assert(string != NULL);
+  sort_names();
+  _Optional const unsigned char *const i = bsearch(string, by_name,
+    ARRAY_SIZE(by_name), sizeof(by_name[0]), compare_name);
+
+  return i == NULL ? -1 : *i;
+}
+
+/* Returns the value of a string of decimal digits, or -1 if invalid. */
+static int parse_number(const char *const string)
+{
+  assert(string != NULL);
+  if (!isdigit((unsigned char)*string)) {
+    return -1;
+  }
+
+  char *end;
+  errno = 0;
+  long int const n = strtol(string, &end, 10);
+  if (*end != '\0' || errno == ERANGE || n > INT_MAX) {
+    return -1;
+  }
+  return (int)n;
+}
+
+int get_flat_index(const char *const name)
+{
+  assert(name != NULL);
+  static const char prefix[] = "flat_";
+  int index = -1;
+
+  if (!strncmp(name, prefix, sizeof(prefix) - 1)) {
+    index = parse_number(name + sizeof(prefix) - 1);
+  }
+
+  /* Reject other spellings of the same number (e.g. leading zeros) */
+  char buffer[NameBufferSize];
+  if (index >= 0 && strcmp(get_flat_name(index, buffer, sizeof(buffer)),
+                           name)) {
+    index = -1;
+  }
+  return index;
+}
+
+int get_obj_index(const char *const name)
+{
+  assert(name != NULL);
+  static const char prefix[] = "apocalypse_";
+  int index = -1;
+
+  size_t const len = strlen(name);
+  char base[NameBufferSize];
+  if (len >= sizeof(base)) {
+    return -1;
+  }
+  memcpy(base, name, len + 1);
+
+  int const n = find_name(base);
+  if (n >= 0) {
+    index = names[n].first;
+  } else if (!strncmp(name, prefix, sizeof(prefix) - 1)) {
+    index = parse_number(name + sizeof(prefix) - 1);
+  } else {
+    /* Strip the frame number from the name of an animated object */
+    char *const suffix = strrchr(base, '_');
+    int const frame = (suffix != NULL && suffix[1] == 'f') ?
+                      parse_number(suffix + 2) : -1;
+    if (frame >= 0) {
+      *suffix = '\0';
+      int const m = find_name(base);
+      if (m >= 0) {
+        if (names[m].first > names[m].last) {
+          if (frame <= 1) {
+            index = frame ? names[m].last : names[m].first;
+          }
+        } else if (frame <= names[m].last - names[m].first) {
+          index = names[m].first + frame;
+        }
+      }
+    }
+  }
+
+  /* The name must be exactly what get_obj_name would produce for the
+     index, e.g. a single object has no frame number. */
+  char buffer[NameBufferSize];
+  if (index >= 0 && strcmp(get_obj_name(index, buffer, sizeof(buffer)),
+                           name)) {
+    index = -1;
+  }
+  return index;
+}
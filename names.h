@@ -7,7 +7,25 @@
 #ifndef APOCNAMES_H
 #define APOCNAMES_H
 
-const char *get_flat_name(int index);
-const char *get_obj_name(int index);
+/* ISO C library headers */
+#include <stddef.h>
+
+enum {
+  NameBufferSize = 64, /* big enough for any flat or object name */
+};
+
+/* These functions may return a pointer into the given buffer, which
+   must be at least NameBufferSize bytes long. */
+const char *get_flat_name(int index, char *buffer, size_t buffer_size);
+const char *get_obj_name(int index, char *buffer, size_t buffer_size);
+
+/* These functions return the index of the named flat or object,
+   or -1 if no index has that name. */
+int get_flat_index(const char *name);
+int get_obj_index(const char *name);
+
+/* Returns a number identifying the animated model of which an object is
+   one frame, or -1 if the object isn't animated. */
+int get_obj_model(int index);
 
 #endif /* APOCNAMES_H */
@@ -0,0 +1,294 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  OBJ-format text for vertices and faces
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local header files */
+#include "objout.h"
+#include "meshout.h"
+#include "misc.h"
+
+enum {
+  MinNumSides = 3,
+  IntBufferSize = 24, /* enough for any long long int */
+  MaterialBufferSize = 64,
+};
+
+/* Formats an integer in decimal, returning the no. of characters. */
+static size_t format_int(char * const buf, long long int const value)
+{
+  assert(buf != NULL);
+
+  char digits[IntBufferSize];
+  unsigned long long int u = value < 0 ? -(unsigned long long int)value :
+                                         (unsigned long long int)value;
+  size_t n = 0;
+  do {
+    digits[n++] = (char)('0' + (int)(u % 10));
+    u /= 10;
+  } while (u > 0);
+
+  size_t len = 0;
+  if (value < 0) {
+    buf[len++] = '-';
+  }
+  while (n > 0) {
+    buf[len++] = digits[--n];
+  }
+  return len;
+}
+
+/* Coordinates in the input are integers, so printf is only needed for
+   those made by clipping. */
+size_t obj_format_coord(char * const buf, Coord const value)
+{
+  assert(buf != NULL);
+
+  /* Whole numbers of up to 15 digits are exactly representable */
+  if (value > -1e15 && value < 1e15) {
+    long long int const whole = (long long int)value;
+    if ((Coord)whole == value && (whole != 0 || !signbit(value))) {
+      static const char decimals[] = ".000000";
+      size_t const len = format_int(buf, whole);
+      memcpy(buf + len, decimals, sizeof(decimals) - 1);
+      return len + sizeof(decimals) - 1;
+    }
+  }
+
+  int const len = snprintf(buf, ObjCoordBufferSize, "%f", (double)value);
+  return (len > 0 && len < ObjCoordBufferSize) ? (size_t)len : 0;
+}
+
+/* Appends "v x y z" for every vertex marked as used, and gets the
+   output number of each vertex. */
+static bool format_vertices(ByteBuffer * const out,
+                            const VertexArray * const varray,
+                            int * const ids)
+{
+  assert(out != NULL);
+  assert(varray != NULL);
+  assert(ids != NULL);
+
+  int const nvertices = vertex_array_get_num_vertices(varray);
+  int count = 0;
+
+  for (int v = 0; v < nvertices; ++v) {
+    ids[v] = -1;
+    if (!vertex_array_is_used(varray, v)) {
+      continue;
+    }
+
+    _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, v);
+    if (coords == NULL) {
+      fprintf(stderr, "Bad vertex %d for output\n", v);
+      return false;
+    }
+
+    char line[2 + (3 * ObjCoordBufferSize)];
+    size_t len = 0;
+    line[len++] = 'v';
+    for (int i = 0; i < 3; ++i) {
+      line[len++] = ' ';
+      size_t const n = obj_format_coord(line + len, (*coords)[i]);
+      if (n == 0) {
+        fprintf(stderr, "Failed to format vertex %d for output\n", v);
+        return false;
+      }
+      len += n;
+    }
+    line[len++] = '\n';
+
+    if (!byte_buffer_append(out, line, len)) {
+      return false;
+    }
+    ids[v] = count++;
+  }
+  return true;
+}
+
+/* Gives each duplicate vertex which isn't output the number of the vertex
+   with the same coordinates which is, by looking up the output vertices
+   in a hash table. */
+static bool number_duplicates(const VertexArray * const varray,
+                              int * const ids,
+                              _Optional Arena * const arena)
+{
+  assert(varray != NULL);
+  assert(ids != NULL);
+
+  int const nvertices = vertex_array_get_num_vertices(varray);
+  int v = 0;
+  while (v < nvertices && ids[v] >= 0) {
+    ++v;
+  }
+  if (v == nvertices) {
+    return true; /* no vertex was left out */
+  }
+
+  size_t nentries = 1;
+  while (nentries <= (size_t)nvertices * 2) {
+    nentries *= 2;
+  }
+
+  size_t const size = sizeof(int) * nentries;
+  _Optional int *const table = arena != NULL ? arena_alloc(&*arena, size) :
+                                               malloc(size);
+  if (table == NULL) {
+    fputs("Failed to allocate memory for duplicate vertices\n", stderr);
+    return false;
+  }
+  memset(&*table, 0, size);
+
+  for (int u = 0; u < nvertices; ++u) {
+    if (ids[u] >= 0) {
+      _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, u);
+      assert(coords != NULL);
+      (void)vertex_table_find(&*table, nentries, varray, u, &*coords);
+    }
+  }
+
+  for (; v < nvertices; ++v) {
+    if (ids[v] >= 0) {
+      continue;
+    }
+    _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, v);
+    if (coords != NULL) {
+      ids[v] = ids[vertex_table_find(&*table, nentries, varray, v, &*coords)];
+    }
+  }
+
+  if (arena == NULL) {
+    free(table);
+  }
+  return true;
+}
+
+bool obj_can_format(const Group * const group, MeshStyle const mstyle)
+{
+  assert(group != NULL);
+
+  if (mstyle != MeshStyle_NoChange) {
+    return false;
+  }
+
+  int const nprimitives = group_get_num_primitives(group);
+  for (int p = 0; p < nprimitives; ++p) {
+    _Optional const Primitive *const pp = group_get_primitive(group, p);
+    if (pp == NULL || primitive_get_num_sides(&*pp) < MinNumSides) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool obj_format_object(ByteBuffer * const out, int const vobject,
+                       const VertexArray * const varray,
+                       const Group * const group, int const vtotal,
+                       _Optional OutputPrimitivesGetColourFn * const get_colour,
+                       OutputPrimitivesGetMaterialFn * const get_material,
+                       void * const arg, VertexStyle const vstyle,
+                       _Optional Arena * const arena)
+{
+  assert(out != NULL);
+  assert(vobject >= 0);
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(vtotal >= 0);
+  assert(get_material != NULL);
+  assert(obj_can_format(group, MeshStyle_NoChange));
+
+  int const nvertices = vertex_array_get_num_vertices(varray);
+  size_t const size = sizeof(int) * ((size_t)nvertices + 1);
+  _Optional int *const ids = arena != NULL ? arena_alloc(&*arena, size) :
+                                             malloc(size);
+  if (ids == NULL) {
+    fputs("Failed to allocate memory for vertex numbers\n", stderr);
+    return false;
+  }
+
+  bool success = format_vertices(out, varray, &*ids) &&
+                 number_duplicates(varray, &*ids, arena);
+
+  int const nprimitives = group_get_num_primitives(group);
+  int last_colour = -1;
+
+  for (int p = 0; success && p < nprimitives; ++p) {
+    _Optional const Primitive *const pp = group_get_primitive(group, p);
+    if (pp == NULL) {
+      success = false;
+      break;
+    }
+
+    int const colour = get_colour != NULL ? get_colour(&*pp, arg) :
+                                            primitive_get_colour(&*pp);
+    if (colour != last_colour) {
+      static const char usemtl[] = "usemtl ";
+      char material[MaterialBufferSize];
+      int const len = get_material(material, sizeof(material), colour, arg);
+      if (len < 0) {
+        fprintf(stderr, "Failed to get material for colour %d\n", colour);
+        success = false;
+        break;
+      }
+      success = byte_buffer_append(out, usemtl, sizeof(usemtl) - 1) &&
+                byte_buffer_append(out, material, strlen(material)) &&
+                byte_buffer_append(out, "\n", 1);
+      last_colour = colour;
+    }
+
+    success = success && byte_buffer_append(out, "f", 1);
+
+    int const nsides = primitive_get_num_sides(&*pp);
+    for (int s = 0; success && s < nsides; ++s) {
+      int const id = ids[primitive_get_side(&*pp, s)];
+      if (id < 0 || id >= vobject) {
+        fprintf(stderr, "Bad vertex for side %d of primitive %d\n", s, p);
+        success = false;
+        break;
+      }
+
+      char index[1 + IntBufferSize];
+      index[0] = ' ';
+      size_t const len = 1 + format_int(index + 1,
+        vstyle == VertexStyle_Negative ? (long long int)id - vobject :
+                                         (long long int)vtotal + id + 1);
+      success = byte_buffer_append(out, index, len);
+    }
+
+    success = success && byte_buffer_append(out, "\n", 1);
+  }
+
+  if (arena == NULL) {
+    free(ids);
+  }
+  return success;
+}
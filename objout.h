@@ -0,0 +1,55 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  OBJ-format text for vertices and faces
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef OBJOUT_H
+#define OBJOUT_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <float.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local headers */
+#include "bytebuf.h"
+#include "arena.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+enum {
+  ObjCoordBufferSize = DBL_MAX_10_EXP + 16 /* enough for any "%f" output */
+};
+
+/* Formats a coordinate as printf("%f") would, without a terminator,
+   returning the no. of characters, or 0 on error. buf must have room
+   for ObjCoordBufferSize characters. */
+size_t obj_format_coord(char *buf, Coord value);
+
+/* Returns true if obj_format_object() can format the primitives of a
+   group in the given mesh style. Others must be written by 3dObjLib. */
+bool obj_can_format(const Group *group, MeshStyle mstyle);
+
+/* Appends the vertex and face lines of an object to a buffer, in the same
+   format as output_vertices() and output_primitives() of 3dObjLib, but
+   without calling printf for coordinates that are whole numbers.
+   vobject is the no. of vertices to be output and vtotal the no. already
+   output. Temporary data is allocated from arena, if not null. */
+bool obj_format_object(ByteBuffer *out, int vobject,
+                       const VertexArray *varray, const Group *group,
+                       int vtotal,
+                       _Optional OutputPrimitivesGetColourFn *get_colour,
+                       OutputPrimitivesGetMaterialFn *get_material,
+                       void *arg, VertexStyle vstyle,
+                       _Optional Arena *arena);
+
+#endif /* OBJOUT_H */
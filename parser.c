@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <ctype.h>
 
 /* StreamLib headers */
 #include "Reader.h"
@@ -46,21 +47,215 @@
 #include "version.h"
 #include "names.h"
 #include "colours.h"
+#include "decode.h"
+#include "jobs.h"
+#include "cache.h"
+#include "fragment.h"
+#include "planes.h"
+#include "glb.h"
+#include "ply.h"
+#include "archive.h"
+#include "model.h"
+#include "mapfile.h"
+#include "objout.h"
+#include "meshout.h"
+#include "stats.h"
 #include "misc.h"
 
 enum {
-  MaxNumObjects = 200,
-  MaxNumFlats = 26,
   MaxNumVertices = 256,
   MinNumSides = 3,
   MaxNumSides = 7,
+  DuplicateTableSize = MaxNumVertices * 2, /* a power of two */
+  BytesPerVertex = 12,
+  BytesPerFlatVertex = 8,
   BytesPerPrimitive = 8,
   FlatColour = 0,
   NColours = 256,
   NTints = 1 << 2,
   LoadAddress = 0x8f00,
+  FlatIndexAddress = 0x18b64,
+  MeshIndexAddress = 0x19b6c,
+  MaxFragmentKeyLen = 255,
+  MaxMaterialNameLen = 31,
 };
 
+struct Materials {
+  char name[NColours][MaxMaterialNameLen + 1];
+  unsigned char len[NColours];
+};
+
+/* The whole input is held in memory (usually a read-only mapping of the
+   file) and object records are decoded directly from it. */
+typedef struct {
+  const unsigned char *data;
+  long int size;
+  long int pos;
+  _Optional ApocStats *stats; /* or NULL if not wanted */
+} Input;
+
+static long int input_tell(const Input * const in)
+{
+  assert(in != NULL);
+  return in->pos;
+}
+
+static bool input_seek(Input * const in, const long int pos)
+{
+  assert(in != NULL);
+  if (pos < 0 || pos > in->size) {
+    return false;
+  }
+  in->pos = pos;
+  if (in->stats != NULL) {
+    ++in->stats->seeks;
+  }
+  return true;
+}
+
+static bool input_read_int32(int32_t *const value, Input * const in)
+{
+  assert(value != NULL);
+  assert(in != NULL);
+  if (in->size - in->pos < (long int)sizeof(int32_t)) {
+    in->pos = in->size;
+    return false;
+  }
+  *value = decode_int32(in->data + in->pos);
+  in->pos += sizeof(int32_t);
+  if (in->stats != NULL) {
+    in->stats->bytes_read += sizeof(int32_t);
+  }
+  return true;
+}
+
+/* Returns a pointer to the next n bytes of input (and skips them), or
+   NULL if fewer than n bytes remain. */
+static _Optional const unsigned char *input_read_block(Input * const in,
+                                                       const long int n)
+{
+  assert(in != NULL);
+  assert(n >= 0);
+  if (in->size - in->pos < n) {
+    return NULL;
+  }
+  const unsigned char *const block = in->data + in->pos;
+  in->pos += n;
+  if (in->stats != NULL) {
+    in->stats->bytes_read += (uint64_t)n;
+  }
+  return block;
+}
+
+static long int input_remaining(const Input * const in)
+{
+  assert(in != NULL);
+  return in->size - in->pos;
+}
+
+/* Reads and checks the number of vertices in an object header. These
+   reading functions are shared by the converter and the model, so that
+   both accept the same objects. */
+static bool read_num_vertices(Input * const r, const int object_count,
+                              int32_t * const nvertices)
+{
+  assert(r != NULL);
+  assert(object_count >= 0);
+  assert(nvertices != NULL);
+
+  if (!input_read_int32(nvertices, r)) {
+    fprintf(stderr, "Failed to read number of vertices (object %d)\n",
+            object_count);
+    return false;
+  }
+
+  if ((*nvertices < 1) || (*nvertices > MaxNumVertices)) {
+    fprintf(stderr, "Bad number of vertices, %lld (object %d)\n",
+            (long long signed int)*nvertices, object_count);
+    return false;
+  }
+  return true;
+}
+
+/* Reads and checks the number of primitives which follows the vertices
+   of an object (other than a flat). */
+static bool read_num_primitives(Input * const r, const int object_count,
+                                int32_t * const nprimitives)
+{
+  assert(r != NULL);
+  assert(object_count >= 0);
+  assert(nprimitives != NULL);
+
+  if (!input_read_int32(nprimitives, r)) {
+    fprintf(stderr, "Failed to read number of primitives (object %d)\n",
+            object_count);
+    return false;
+  }
+
+  if (*nprimitives < 1) {
+    fprintf(stderr, "Bad number of primitives, %lld (object %d)\n",
+            (long long signed int)*nprimitives, object_count);
+    return false;
+  }
+  return true;
+}
+
+/* Returns a pointer to the vertex definitions of an object (and skips
+   them), or NULL if they are truncated. */
+static _Optional const unsigned char *read_vertex_block(Input * const r,
+  const int nvertices, const unsigned int flags)
+{
+  assert(r != NULL);
+  assert(nvertices > 0);
+  assert(nvertices <= MaxNumVertices);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int const bytes_per_vertex = (flags & FLAGS_FLATS) ? BytesPerFlatVertex :
+                                                       BytesPerVertex;
+  _Optional const unsigned char *const block =
+    input_read_block(r, (long int)nvertices * bytes_per_vertex);
+  if (block == NULL) {
+    fprintf(stderr, "Failed to read vertex %ld\n",
+            input_remaining(r) / bytes_per_vertex);
+  }
+  return block;
+}
+
+/* Gets pointers to the primitive definitions of an object and their
+   colours (and skips them). Returns false if either is truncated. */
+static bool read_primitive_blocks(Input * const r, const int object_count,
+                                  const int nprimitives,
+                                  const unsigned char ** const prims,
+                                  const unsigned char ** const colours)
+{
+  assert(r != NULL);
+  assert(object_count >= 0);
+  assert(nprimitives > 0);
+  assert(prims != NULL);
+  assert(colours != NULL);
+
+  /* The primitive definitions and their colours are two contiguous
+     blocks, so fetch both before decoding anything. */
+  _Optional const unsigned char *const p =
+    input_read_block(r, (long int)nprimitives * BytesPerPrimitive);
+  if (p == NULL) {
+    fprintf(stderr, "Failed to read primitive %ld of object %d\n",
+            input_remaining(r) / BytesPerPrimitive, object_count);
+    return false;
+  }
+
+  _Optional const unsigned char *const c = input_read_block(r, nprimitives);
+  if (c == NULL) {
+    fprintf(stderr, "Failed to read colour (primitive %ld of object %d)\n",
+            input_remaining(r), object_count);
+    return false;
+  }
+
+  *prims = &*p;
+  *colours = &*c;
+  return true;
+}
+
 static void flip_backfacing(VertexArray * const varray,
                             Group * const group,
                             const unsigned int flags)
@@ -85,14 +280,87 @@ static void flip_backfacing(VertexArray * const varray,
   }
 }
 
-static bool parse_flat(Reader * const r, const int object_count,
+/* Maps each used vertex to the first used vertex with the same coordinates
+   (or itself), by hashing the coordinates instead of comparing every pair
+   of vertices. */
+static void find_duplicates(const VertexArray * const varray,
+                            const bool * const used, int * const remap,
+                            const int object_count, const unsigned int flags)
+{
+  assert(varray != NULL);
+  assert(used != NULL);
+  assert(remap != NULL);
+  assert(object_count >= 0);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int const nvertices = vertex_array_get_num_vertices(varray);
+  assert(nvertices <= MaxNumVertices);
+
+  /* Entries are vertex numbers + 1, so that 0 means free */
+  int table[DuplicateTableSize] = {0};
+  int count = 0;
+
+  for (int v = 0; v < nvertices; ++v) {
+    remap[v] = v;
+    if (!used[v]) {
+      continue;
+    }
+
+    _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, v);
+    if (!coords) {
+      continue;
+    }
+
+    remap[v] = vertex_table_find(table, ARRAY_SIZE(table), varray, v,
+                                 &*coords);
+    if (remap[v] != v) {
+      if (flags & FLAGS_VERBOSE) {
+        printf("Vertex %d duplicates vertex %d (object %d)\n",
+               v, remap[v], object_count);
+      }
+      ++count;
+    }
+  }
+
+  DEBUGF("Found %d duplicate vertices in object %d\n", count, object_count);
+}
+
+/* Adds decoded vertices to an array. This is inlined with a constant
+   value of verbose, so that the usual variant has no test in its loop. */
+static inline bool add_vertices(VertexArray * const varray,
+                                Coord (* const coords)[3],
+                                const int nvertices, const int object_count,
+                                const bool verbose)
+{
+  assert(varray != NULL);
+  assert(coords != NULL);
+  assert(nvertices > 0);
+  assert(object_count >= 0);
+
+  for (int v = 0; v < nvertices; ++v) {
+    if (vertex_array_add_vertex(varray, &coords[v]) < 0) {
+      fprintf(stderr, "Failed to allocate vertex memory "
+              "(vertex %d of object %d)\n", v, object_count);
+      return false;
+    }
+
+    if (verbose) {
+      vertex_array_print_vertex(varray, v);
+      puts("");
+    }
+  } /* next vertex */
+
+  return true;
+}
+
+static bool parse_flat(Input * const r, const int object_count,
                        VertexArray * const varray,
                        const int nvertices,
                        Group * const group,
+                       _Optional int * const remap,
                        const unsigned int flags)
 {
   assert(r != NULL);
-  assert(!reader_ferror(r));
   assert(object_count >= 0);
   assert(varray != NULL);
   assert(nvertices > 0);
@@ -101,11 +369,12 @@ static bool parse_flat(Reader * const r, const int object_count,
   assert(!(flags & ~FLAGS_ALL));
 
   if (flags & FLAGS_VERBOSE) {
-    const long int vertices_start = reader_ftell(r);
+    const long int vertices_start = input_tell(r);
     printf("Found %d vertices at file position %ld (0x%lx)\n",
            nvertices, vertices_start, vertices_start);
   }
 
+  double start = apoc_stats_start(r->stats);
   _Optional Primitive *pp = NULL;
 
   if (!(flags & FLAGS_LIST)) {
@@ -124,33 +393,59 @@ static bool parse_flat(Reader * const r, const int object_count,
     primitive_set_id(&*pp, group_get_num_primitives(group));
   }
 
+  /* Fetch and convert the whole vertex block at once */
+  _Optional const unsigned char *const block =
+    read_vertex_block(r, nvertices, flags);
+  if (block == NULL) {
+    return false;
+  }
+
+  if (flags & FLAGS_LIST) {
+    apoc_stats_stop(r->stats, ApocStage_ParseVertices, start);
+    return true;
+  }
+
+  Coord xy[MaxNumVertices][2];
+  decode_coords(&*block, &xy[0][0], (size_t)nvertices * ARRAY_SIZE(xy[0]));
+
+  Coord coords[MaxNumVertices][3];
   for (int v = 0; v < nvertices; ++v) {
-    Coord pos[3] = {0.0, 0.0, 0.0};
-    for (size_t dim = 0; dim < 2; ++dim) {
-      int32_t coord;
-      if (!reader_fread_int32(&coord, r)) {
-        fprintf(stderr, "Failed to read vertex %d\n", v);
-        return false;
-      }
-      pos[dim] = coord;
-    } /* next dimension */
+    coords[v][0] = xy[v][0];
+    coords[v][1] = xy[v][1];
+    coords[v][2] = 0.0;
+  }
 
-    if (flags & FLAGS_LIST) {
-      continue;
-    }
+  bool const success = (flags & FLAGS_VERBOSE) ?
+    add_vertices(varray, coords, nvertices, object_count, true) :
+    add_vertices(varray, coords, nvertices, object_count, false);
+  if (!success) {
+    return false;
+  }
 
-    if (vertex_array_add_vertex(varray, &pos) < 0) {
-      fprintf(stderr, "Failed to allocate vertex memory "
-              "(vertex %d of object %d)\n", v, object_count);
-      return false;
-    }
+  int identity[MaxNumVertices];
+  const int *map = identity;
 
-    if (flags & FLAGS_VERBOSE) {
-      vertex_array_print_vertex(varray, v);
-      puts("");
+  if (remap != NULL) {
+    /* Every vertex of a flat is used. The whole array is initialised
+       because find_duplicates() reads the vertex count from varray. */
+    bool used[MaxNumVertices] = {false};
+    for (int v = 0; v < nvertices; ++v) {
+      used[v] = true;
     }
+    apoc_stats_stop(r->stats, ApocStage_ParseVertices, start);
+    start = apoc_stats_start(r->stats);
+    find_duplicates(varray, used, &*remap, object_count, flags);
+    apoc_stats_stop(r->stats, ApocStage_FindDuplicates, start);
+    start = apoc_stats_start(r->stats);
+    map = &*remap;
+  } else {
+    for (int v = 0; v < nvertices; ++v) {
+      identity[v] = v;
+    }
+  }
 
-    if (primitive_add_side(&*pp, v) < 0) {
+  for (int v = 0; v < nvertices; ++v) {
+    if (primitive_add_side(&*pp, map[v]) < 0) {
       fprintf(stderr, "Failed to add side: too many sides? "
                       "(side %d of object %d)\n",
               v, object_count);
@@ -158,33 +453,29 @@ static bool parse_flat(Reader * const r, const int object_count,
     }
   } /* next side */
 
-  if (flags & FLAGS_LIST) {
-    return true;
-  }
-
   if (flags & FLAGS_VERBOSE) {
     puts("Flat:");
     primitive_print(&*pp, varray);
     puts("");
   }
 
+  apoc_stats_stop(r->stats, ApocStage_ParseVertices, start);
   return true;
 }
 
-static bool parse_vertices(Reader * const r, const int object_count,
+static bool parse_vertices(Input * const r, const int object_count,
                            VertexArray * const varray,
                            const int nvertices,
                            const unsigned int flags)
 {
   assert(r != NULL);
-  assert(!reader_ferror(r));
   assert(object_count >= 0);
   assert(varray != NULL);
   assert(nvertices > 0);
   assert(nvertices <= MaxNumVertices);
   assert(!(flags & ~FLAGS_ALL));
 
-  const long int vertices_start = reader_ftell(r);
+  const long int vertices_start = input_tell(r);
 
   if (flags & FLAGS_VERBOSE) {
     printf("Found %d vertices at file position %ld (0x%lx)\n",
@@ -198,164 +489,224 @@ static bool parse_vertices(Reader * const r, const int object_count,
     return false;
   }
 
-  for (int v = 0; v < nvertices; ++v) {
-    Coord pos[3] = {0.0, 0.0, 0.0};
-    for (size_t dim = 0; dim < ARRAY_SIZE(pos); ++dim) {
-      int32_t coord;
-      if (!reader_fread_int32(&coord, r)) {
-        fprintf(stderr, "Failed to read vertex %d\n", v);
+  /* Fetch and convert the whole vertex block at once */
+  _Optional const unsigned char *const block =
+    read_vertex_block(r, nvertices, flags);
+  if (block == NULL) {
+    return false;
+  }
+
+  if (flags & FLAGS_LIST) {
+    return true;
+  }
+
+  Coord coords[MaxNumVertices][3];
+  decode_coords(&*block, &coords[0][0],
+                (size_t)nvertices * ARRAY_SIZE(coords[0]));
+
+  return (flags & FLAGS_VERBOSE) ?
+         add_vertices(varray, coords, nvertices, object_count, true) :
+         add_vertices(varray, coords, nvertices, object_count, false);
+}
+
+/* Checks the side counts and vertex indices of a block of primitive
+   definitions. No switch affects this, so its loops test only the data. */
+static bool check_primitives(const unsigned char * const prims,
+                             const int nprimitives, const int nvertices,
+                             const int object_count)
+{
+  assert(prims != NULL);
+  assert(nprimitives > 0);
+  assert(nvertices > 0);
+  assert(object_count >= 0);
+
+  for (int p = 0; p < nprimitives; ++p) {
+    const unsigned char *const prim = prims + (p * BytesPerPrimitive);
+    const int nsides = prim[0];
+
+    if (nsides < MinNumSides || nsides > MaxNumSides) {
+      fprintf(stderr, "Bad side count %d (primitive %d of object %d)\n",
+              nsides, p, object_count);
+      return false;
+    }
+
+    for (int s = 0; s < nsides; ++s) {
+      const int v = prim[1 + s];
+      if (v >= nvertices) {
+        fprintf(stderr, "Bad vertex %d (side %d of primitive %d "
+                "of object %d)\n", v, s, p, object_count);
         return false;
       }
-      pos[dim] = coord;
-    } /* next dimension */
+    }
+  }
+  return true;
+}
 
-    if (flags & FLAGS_LIST) {
-      continue;
+/* Adds validated primitives to a group, using map to renumber their
+   vertices. This is inlined with a constant value of verbose, so that the
+   usual variant has no test in its loops. */
+static inline bool add_primitives(const VertexArray * const varray,
+                                  Group * const group,
+                                  const unsigned char * const prims,
+                                  const unsigned char * const colours,
+                                  const int nprimitives,
+                                  const int * const map,
+                                  const long int primitives_start,
+                                  const int object_count,
+                                  const bool verbose)
+{
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(prims != NULL);
+  assert(colours != NULL);
+  assert(nprimitives > 0);
+  assert(map != NULL);
+  assert(object_count >= 0);
+
+  for (int p = 0; p < nprimitives; ++p) {
+    const unsigned char *const prim = prims + (p * BytesPerPrimitive);
+    if (verbose) {
+      const long int primitive_start = primitives_start +
+                                       (p * BytesPerPrimitive);
+      printf("Found primitive %d at file position %ld (0x%lx)\n",
+             p, primitive_start, primitive_start);
     }
 
-    if (vertex_array_add_vertex(varray, &pos) < 0) {
-      fprintf(stderr, "Failed to allocate vertex memory "
-              "(vertex %d of object %d)\n", v, object_count);
+    _Optional Primitive * const pp = group_add_primitive(group);
+    if (pp == NULL) {
+      fprintf(stderr, "Failed to allocate primitive memory "
+              "(primitive %d of object %d)\n", p, object_count);
       return false;
     }
+    primitive_set_id(&*pp, group_get_num_primitives(group));
 
-    if (flags & FLAGS_VERBOSE) {
-      vertex_array_print_vertex(varray, v);
+    const int nsides = prim[0];
+    for (int s = 0; s < nsides; ++s) {
+      if (primitive_add_side(&*pp, map[prim[1 + s]]) < 0) {
+        fprintf(stderr, "Failed to add side: too many sides? "
+                        "(side %d of primitive %d of object %d)\n",
+                s, p, object_count);
+        return false;
+      }
+    }
+
+    primitive_set_colour(&*pp, colours[p]);
+
+    int const side = primitive_get_skew_side(&*pp, varray);
+    if (side >= 0) {
+      fprintf(stderr, "Warning: skew polygon detected "
+                      "(side %d of primitive %d of object %d)\n",
+              side, p, object_count);
+    }
+
+    if (verbose) {
+      printf("Primitive %d:\n",
+             group_get_num_primitives(group) - 1);
+      primitive_print(&*pp, varray);
       puts("");
     }
-  } /* next vertex */
+  } /* next primitive */
 
   return true;
 }
 
-static bool parse_primitives(Reader * const r, const int object_count,
+static bool parse_primitives(Input * const r, const int object_count,
                              VertexArray * const varray,
                              Group * const group,
                              const int nprimitives,
+                             _Optional int * const remap,
                              const unsigned int flags)
 {
   assert(r != NULL);
   assert(object_count >= 0);
-  assert(!reader_ferror(r));
   assert(group != NULL);
   assert(nprimitives > 0);
   assert(!(flags & ~FLAGS_ALL));
 
+  const long int primitives_start = input_tell(r);
   if (flags & FLAGS_VERBOSE) {
-    const long int primitives_start = reader_ftell(r);
     printf("Found %d primitives at file position %ld (0x%lx)\n",
            nprimitives, primitives_start, primitives_start);
   }
 
-  for (int p = 0; p < nprimitives; ++p) {
-    const long int primitive_start = reader_ftell(r);
-    if (flags & FLAGS_VERBOSE) {
-      printf("Found primitive %d at file position %ld (0x%lx)\n",
-             p, primitive_start, primitive_start);
-    }
-
-    if (!(flags & FLAGS_LIST)) {
-      _Optional Primitive * const pp = group_add_primitive(group);
-      if (pp == NULL) {
-        fprintf(stderr, "Failed to allocate primitive memory "
-                "(primitive %d of object %d)\n", p, object_count);
-        return false;
-      }
-      primitive_set_id(&*pp, group_get_num_primitives(group));
-
-      const int nsides = reader_fgetc(r);
-      if (nsides == EOF) {
-        fprintf(stderr, "Failed to read no. of sides (primitive %d of object %d)\n",
-                p, object_count);
-        return false;
-      }
-
-      if (nsides < MinNumSides || nsides > MaxNumSides) {
-        fprintf(stderr, "Bad side count %d (primitive %d of object %d)\n",
-                nsides, p, object_count);
-        return false;
-      }
-
-      const int nvertices = vertex_array_get_num_vertices(varray);
+  double start = apoc_stats_start(r->stats);
 
-      for (int s = 0; s < nsides; ++s) {
-        int const v = reader_fgetc(r);
-        if (v == EOF) {
-          fprintf(stderr, "Failed to read side %d of primitive %d "
-                  "of object %d\n", s, p, object_count);
-          return false;
-        }
+  const unsigned char *prims, *colours;
+  if (!read_primitive_blocks(r, object_count, nprimitives, &prims,
+                             &colours)) {
+    return false;
+  }
 
-        /* Validate the vertex indices */
-        if (v < 0 || v >= nvertices) {
-          fprintf(stderr, "Bad vertex %lld (side %d of primitive %d "
-                  "of object %d)\n", (long long signed)v, s, p,
-                  object_count);
-          return false;
-        }
+  if (flags & FLAGS_LIST) {
+    apoc_stats_stop(r->stats, ApocStage_ParsePrimitives, start);
+    return true;
+  }
 
-        if (primitive_add_side(&*pp, v) < 0) {
-          fprintf(stderr, "Failed to add side: too many sides? "
-                          "(side %d of primitive %d of object %d)\n",
-                  s, p, object_count);
-          return false;
-        }
-      }
+  /* Validate the side counts and vertex indices before allocating any
+     primitives */
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  if (!check_primitives(prims, nprimitives, nvertices, object_count)) {
+    return false;
+  }
 
-      int const side = primitive_get_skew_side(&*pp, varray);
-      if (side >= 0) {
-        fprintf(stderr, "Warning: skew polygon detected "
-                        "(side %d of primitive %d of object %d)\n",
-                side, p, object_count);
+  /* Vertices are renumbered through a map even if they aren't merged,
+     which is cheaper than testing for a map in the loop. */
+  int identity[MaxNumVertices];
+  const int *map = identity;
+
+  if (remap != NULL) {
+    /* Only vertices that will be output can be merged. If unused vertices
+       are kept then every vertex is used and primitives needn't be
+       scanned. */
+    bool used[MaxNumVertices] = {false};
+    if (flags & FLAGS_UNUSED) {
+      for (int v = 0; v < nvertices; ++v) {
+        used[v] = true;
       }
-
-      if (flags & FLAGS_VERBOSE) {
-        printf("Primitive %d:\n",
-               group_get_num_primitives(group) - 1);
-        primitive_print(&*pp, varray);
-        puts("");
+    } else {
+      for (int p = 0; p < nprimitives; ++p) {
+        const unsigned char *const prim = prims + (p * BytesPerPrimitive);
+        for (int s = 0; s < prim[0]; ++s) {
+          used[prim[1 + s]] = true;
+        }
       }
     }
-
-    /* Skip any unused vertex indices */
-    if (reader_fseek(r, primitive_start + BytesPerPrimitive, SEEK_SET)) {
-      fprintf(stderr, "Failed to seek end of primitive "
-              "(primitive %d of object %d)\n", p, object_count);
-      return false;
+    apoc_stats_stop(r->stats, ApocStage_ParsePrimitives, start);
+    start = apoc_stats_start(r->stats);
+    find_duplicates(varray, used, &*remap, object_count, flags);
+    apoc_stats_stop(r->stats, ApocStage_FindDuplicates, start);
+    start = apoc_stats_start(r->stats);
+    map = &*remap;
+  } else {
+    for (int v = 0; v < nvertices; ++v) {
+      identity[v] = v;
     }
-  } /* next primitive */
+  }
+
+  bool const success = (flags & FLAGS_VERBOSE) ?
+    add_primitives(varray, group, prims, colours, nprimitives, map,
+                   primitives_start, object_count, true) :
+    add_primitives(varray, group, prims, colours, nprimitives, map,
+                   primitives_start, object_count, false);
+  if (!success) {
+    return false;
+  }
 
-  /* Read primitive colours */
   if (flags & FLAGS_VERBOSE) {
-    const long int colours_start = reader_ftell(r);
+    const long int colours_start = primitives_start +
+                                   (nprimitives * BytesPerPrimitive);
     printf("Found %d colours at file position %ld (0x%lx)\n",
            nprimitives, colours_start, colours_start);
   }
 
-  for (int p = 0; p < nprimitives; ++p) {
-    const int colour = reader_fgetc(r);
-    if (colour == EOF) {
-      fprintf(stderr, "Failed to read colour (primitive %d of object %d)\n",
-              p, object_count);
-      return false;
-    }
-
-    if (flags & FLAGS_LIST) {
-      continue;
-    }
-    _Optional Primitive *const pp = group_get_primitive(group, p);
-    if (!pp) {
-      continue;
-    }
-    primitive_set_colour(&*pp, colour);
-  }
-
+  apoc_stats_stop(r->stats, ApocStage_ParsePrimitives, start);
   return true;
 }
 
 static void mark_vertices(VertexArray * const varray,
                           Group (* const group),
                           const int object_count,
+                          _Optional const int * const remap,
                           const unsigned int flags)
 {
   assert(group != NULL);
@@ -363,8 +714,18 @@ static void mark_vertices(VertexArray * const varray,
   assert(!(flags & ~FLAGS_ALL));
 
   if (flags & FLAGS_UNUSED) {
-    /* We're keeping all vertices */
-    vertex_array_set_all_used(varray);
+    if (remap != NULL) {
+      /* We're keeping all vertices except merged duplicates */
+      const int nvertices = vertex_array_get_num_vertices(varray);
+      for (int v = 0; v < nvertices; ++v) {
+        if (remap[v] == v) {
+          vertex_array_set_used(varray, v);
+        }
+      }
+    } else {
+      /* We're keeping all vertices */
+      vertex_array_set_all_used(varray);
+    }
   } else {
     /* Mark only the used vertices */
     group_set_used(group, varray);
@@ -391,207 +752,462 @@ static void mark_vertices(VertexArray * const varray,
 
 static int get_false_colour(const Primitive *pp, void *arg)
 {
+  ApocContext *const ctx = arg;
   NOT_USED(pp);
-  NOT_USED(arg);
+  assert(ctx != NULL);
 
-  static int p;
-  const int colour = (p * NTints) % NColours;
-  ++p;
+  const int colour = (ctx->false_colour_count * NTints) % NColours;
+  ctx->false_colour_count = (ctx->false_colour_count + 1) % NColours;
   return colour;
 }
 
-static int get_human_material(char *buf, size_t buf_size,
-                              int const colour, void *arg)
+/* Material names are formatted once per conversion rather than once per
+   primitive. */
+static bool materials_init(Materials * const materials,
+                           const unsigned int flags)
 {
-  NOT_USED(arg);
-  return snprintf(buf, buf_size, "%s_%d",
-                  get_colour_name(colour / NTints), colour % NTints);
+  assert(materials != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  for (int colour = 0; colour < NColours; ++colour) {
+    int const len = (flags & FLAGS_HUMAN_READABLE) ?
+      snprintf(materials->name[colour], sizeof(materials->name[colour]),
+               "%s_%d", get_colour_name(colour / NTints), colour % NTints) :
+      snprintf(materials->name[colour], sizeof(materials->name[colour]),
+               "riscos_%d", colour);
+
+    if (len < 0 || (size_t)len >= sizeof(materials->name[colour])) {
+      fprintf(stderr, "Failed to format material name for colour %d\n",
+              colour);
+      return false;
+    }
+    materials->len[colour] = (unsigned char)len;
+  }
+  return true;
 }
 
 static int get_material(char *const buf, size_t const buf_size,
                         int const colour, void *arg)
 {
-  NOT_USED(arg);
-  return snprintf(buf, buf_size, "riscos_%d", colour);
+  const ApocContext *const ctx = arg;
+  assert(buf != NULL);
+  assert(ctx != NULL);
+  assert(ctx->materials != NULL);
+  const Materials *const materials = &*ctx->materials;
+  assert(colour >= 0);
+  assert(colour < NColours);
+
+  size_t const len = materials->len[colour];
+  if (buf_size > 0) {
+    size_t const n = len < buf_size ? len : buf_size - 1;
+    memcpy(buf, materials->name[colour], n);
+    buf[n] = '\0';
+  }
+  return (int)len;
 }
 
-static bool process_object(Reader * const r, _Optional FILE * const out,
-                           const char * const object_name,
+/* Prepares the vertices and primitives of an object for output by
+   clipping overlapping polygons and culling unused or duplicate vertices.
+   remap is non-null if duplicate vertices were already merged. */
+static bool prepare_object(VertexArray * const varray,
+                           Group * const group,
+                           const int object_count,
+                           _Optional const int * const remap,
+                           int * const vobject,
+                           _Optional ApocStats * const stats,
+                           _Optional Arena * const arena,
+                           const unsigned int flags)
+{
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(object_count >= 0);
+  assert(vobject != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  /* In cases of overlapping coplanar polygons,
+     split the underlying polygon. 3dObjLib clips the whole group at once,
+     so objects with any overlap cost as much to clip as before. */
+  double start = apoc_stats_start(stats);
+  if ((flags & FLAGS_CLIP_POLYGONS) &&
+      planes_can_skip_clipping(varray, group, arena)) {
+    if (flags & FLAGS_VERBOSE) {
+      printf("No overlapping coplanar polygons in object %d\n",
+             object_count);
+    }
+  } else if (flags & FLAGS_CLIP_POLYGONS) {
+    const int group_order[] = {0};
+    if (!clip_polygons(varray, group, group_order,
+                       ARRAY_SIZE(group_order),
+                       (flags & FLAGS_VERBOSE) != 0)) {
+      fprintf(stderr,
+              "Clipping of overlapping coplanar polygons failed\n");
+      return false;
+    }
+  }
+  if (flags & FLAGS_CLIP_POLYGONS) {
+    apoc_stats_stop(stats, ApocStage_Clip, start);
+  }
+
+  /* Mark the vertices in preparation for culling unused ones. */
+  start = apoc_stats_start(stats);
+  mark_vertices(varray, group, object_count, remap, flags);
+  apoc_stats_stop(stats, ApocStage_MarkVertices, start);
+
+  if (!(flags & FLAGS_DUPLICATE) && remap == NULL) {
+    /* Unmark duplicate vertices in preparation for culling them. */
+    start = apoc_stats_start(stats);
+    int const ndup =
+      vertex_array_find_duplicates(varray, (flags & FLAGS_VERBOSE) != 0);
+    apoc_stats_stop(stats, ApocStage_FindDuplicates, start);
+    if (ndup < 0) {
+      fprintf(stderr, "Detection of duplicate vertices failed\n");
+      return false;
+    }
+  }
+
+  int const nvertices = vertex_array_get_num_vertices(varray);
+  start = apoc_stats_start(stats);
+  if (!(flags & FLAGS_UNUSED) || !(flags & FLAGS_DUPLICATE)) {
+    /* Cull unused and/or duplicate vertices */
+    *vobject = vertex_array_renumber(varray, (flags & FLAGS_VERBOSE) != 0);
+    DEBUGF("Renumbered %d vertices\n", *vobject);
+  } else {
+    *vobject = nvertices;
+    DEBUGF("No need to renumber %d vertices\n", *vobject);
+  }
+  apoc_stats_stop(stats, ApocStage_Renumber, start);
+
+  if (stats != NULL) {
+    stats->vertices_culled += (uint64_t)(nvertices - *vobject);
+    stats->primitives_emitted += (uint64_t)group_get_num_primitives(group);
+  }
+
+  return true;
+}
+
+typedef struct {
+  ApocObjectInfo summary;
+  int vobject; /* no. of vertices to be output */
+} ObjectInfo;
+
+/* Parses an object and (if it is to be output) prepares its vertices and
+   primitives for output. Doesn't write anything, so that objects can be
+   converted on different threads. */
+static bool convert_object(Input * const r, const bool output,
                            const int object_count,
                            VertexArray * const varray,
                            Group * const group,
-                           int *const vtotal, bool *const list_title,
+                           ObjectInfo * const info,
+                           _Optional Arena * const arena,
                            const unsigned int flags)
 {
-  long int obj_start = 0;
-
   assert(r != NULL);
-  assert(!reader_ferror(r));
-  assert(object_name != NULL);
-  assert(*object_name != '\0');
   assert(object_count >= 0);
   assert(varray != NULL);
   assert(group != NULL);
-  assert(vtotal != NULL);
-  assert(*vtotal >= 0);
+  assert(info != NULL);
   assert(!(flags & ~FLAGS_ALL));
 
-  if (flags & FLAGS_LIST) {
-    obj_start = reader_ftell(r);
-  }
+  info->summary.file_pos = input_tell(r);
+  info->summary.size = 0;
+  info->summary.nvertices = 0;
+  info->summary.nprimitives = 1;
+  info->vobject = 0;
 
   vertex_array_clear(varray);
   group_delete_all(group);
 
   int32_t nvertices, nprimitives = 1;
 
-  if (!reader_fread_int32(&nvertices, r)) {
-    fprintf(stderr, "Failed to read number of vertices (object %d)\n",
-            object_count);
+  /* Duplicate vertices are merged as primitives are added, unless clipping
+     (which creates new vertices) is needed first. */
+  int remap_buffer[MaxNumVertices];
+  _Optional int *const remap =
+    (output && !(flags & (FLAGS_DUPLICATE | FLAGS_CLIP_POLYGONS))) ?
+    remap_buffer : NULL;
+
+  if (!read_num_vertices(r, object_count, &nvertices)) {
     return false;
   }
 
-  if ((nvertices < 1) || (nvertices > MaxNumVertices)) {
-    fprintf(stderr, "Bad number of vertices, %lld (object %d)\n",
-            (long long signed int)nvertices, object_count);
-    return false;
+  if (r->stats != NULL) {
+    ++r->stats->objects;
   }
 
+  /* The parsing functions record their own times, excluding the time
+     taken to find duplicate vertices as primitives are added. */
   if (flags & FLAGS_FLATS) {
-    if (!parse_flat(r, object_count, varray, nvertices, group, flags)) {
+    if (!parse_flat(r, object_count, varray, nvertices, group, remap,
+                    flags)) {
       return false;
     }
 
     if (flags & FLAGS_FLIP_BACKFACING) {
+      double const start = apoc_stats_start(r->stats);
       flip_backfacing(varray, group, flags);
+      apoc_stats_stop(r->stats, ApocStage_ParseVertices, start);
     }
   } else {
+    double const start = apoc_stats_start(r->stats);
     if (!parse_vertices(r, object_count, varray, nvertices, flags)) {
       return false;
     }
+    apoc_stats_stop(r->stats, ApocStage_ParseVertices, start);
 
-    if (!reader_fread_int32(&nprimitives, r)) {
-      fprintf(stderr, "Failed to read number of primitives (object %d)\n",
-              object_count);
-      return false;
-    }
-
-    if (nprimitives < 1) {
-      fprintf(stderr, "Bad number of primitives, %lld (object %d)\n",
-              (long long signed int)nprimitives, object_count);
+    if (!read_num_primitives(r, object_count, &nprimitives)) {
       return false;
     }
 
     if (!parse_primitives(r, object_count, varray, group,
-                          nprimitives, flags)) {
+                          nprimitives, remap, flags)) {
       return false;
     }
   }
 
-  if (out != NULL) {
-    /* In cases of overlapping coplanar polygons,
-       split the underlying polygon */
-    if (flags & FLAGS_CLIP_POLYGONS) {
-      const int group_order[] = {0};
-      if (!clip_polygons(varray, group, group_order,
-                         ARRAY_SIZE(group_order),
-                         (flags & FLAGS_VERBOSE) != 0)) {
-        fprintf(stderr,
-                "Clipping of overlapping coplanar polygons failed\n");
-        return false;
-      }
-    }
-
-    /* Mark the vertices in preparation for culling unused ones. */
-    mark_vertices(varray, group, object_count, flags);
+  info->summary.size = input_tell(r) - info->summary.file_pos;
+  info->summary.nvertices = nvertices;
+  info->summary.nprimitives = nprimitives;
 
-    if (!(flags & FLAGS_DUPLICATE)) {
-      /* Unmark duplicate vertices in preparation for culling them. */
-      if (vertex_array_find_duplicates(varray,
-                                       (flags & FLAGS_VERBOSE) != 0) < 0) {
-        fprintf(stderr, "Detection of duplicate vertices failed\n");
-        return false;
-      }
-    }
+  if (!output) {
+    return true;
+  }
 
-    int vobject;
-    if (!(flags & FLAGS_UNUSED) || !(flags & FLAGS_DUPLICATE)) {
-      /* Cull unused and/or duplicate vertices */
-      vobject = vertex_array_renumber(varray, (flags & FLAGS_VERBOSE) != 0);
-      DEBUGF("Renumbered %d vertices\n", vobject);
-    } else {
-      vobject = vertex_array_get_num_vertices(varray);
-      DEBUGF("No need to renumber %d vertices\n", vobject);
-    }
+  return prepare_object(varray, group, object_count, remap, &info->vobject,
+                        r->stats, arena, flags);
+}
 
-    if (fprintf(&*out, "\no %s\n", object_name) < 0) {
-      fprintf(stderr,
-              "Failed writing to output file: %s\n",
-              strerror(errno));
-      return false;
-    }
+/* Gets the style in which polygons are to be output. */
+static MeshStyle get_mesh_style(const unsigned int flags)
+{
+  assert(!(flags & ~FLAGS_ALL));
 
-    VertexStyle vstyle = VertexStyle_Positive;
-    if (flags & FLAGS_NEGATIVE_INDICES) {
-      vstyle = VertexStyle_Negative;
-    }
+  if (flags & FLAGS_TRIANGLE_FANS) {
+    return MeshStyle_TriangleFan;
+  }
+  if (flags & FLAGS_TRIANGLE_STRIPS) {
+    return MeshStyle_TriangleStrip;
+  }
+  return MeshStyle_NoChange;
+}
 
-    MeshStyle mstyle = MeshStyle_NoChange;
-    if (flags & FLAGS_TRIANGLE_FANS) {
-      mstyle = MeshStyle_TriangleFan;
-    } else if (flags & FLAGS_TRIANGLE_STRIPS) {
-      mstyle = MeshStyle_TriangleStrip;
-    }
+/* Appends the output for an object to a buffer, if obj_can_format()
+   returned true for it. Temporary data is allocated from arena. */
+static bool format_object(ByteBuffer * const text,
+                          const char * const object_name,
+                          const VertexArray * const varray,
+                          const Group * const group,
+                          const ObjectInfo * const info,
+                          int const vtotal, ApocContext * const ctx,
+                          Arena * const arena, const unsigned int flags)
+{
+  assert(text != NULL);
+  assert(object_name != NULL);
+  assert(*object_name != '\0');
+  assert(info != NULL);
+  assert(!(flags & ~FLAGS_ALL));
 
-    if (!output_vertices(&*out, vobject, varray, -1) ||
-        !output_primitives(&*out, object_name, *vtotal, vobject,
-                           varray, group, 1,
+  return byte_buffer_append(text, "\no ", 3) &&
+         byte_buffer_append(text, object_name, strlen(object_name)) &&
+         byte_buffer_append(text, "\n", 1) &&
+         obj_format_object(text, info->vobject, varray, group, vtotal,
                            (flags & FLAGS_FALSE_COLOUR) ?
-                             get_false_colour : (OutputPrimitivesGetColourFn *)NULL,
-                           (flags & FLAGS_HUMAN_READABLE) ?
-                             get_human_material : get_material,
-                           (void *)NULL, vstyle, mstyle)) {
-      fprintf(stderr, "Failed writing to output file: %s\n",
-              strerror(errno));
+                             get_false_colour :
+                             (OutputPrimitivesGetColourFn *)NULL,
+                           get_material, ctx,
+                           (flags & FLAGS_NEGATIVE_INDICES) ?
+                             VertexStyle_Negative : VertexStyle_Positive,
+                           arena);
+}
+
+static bool write_text(FILE * const out, const ByteBuffer * const text)
+{
+  assert(out != NULL);
+  assert(text != NULL);
+
+  if (text->len > 0 &&
+      fwrite(&*text->data, 1, text->len, out) != text->len) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static bool write_object(FILE * const out, const char * const object_name,
+                         const VertexArray * const varray,
+                         const Group * const group,
+                         const ObjectInfo * const info,
+                         int *const vtotal, ApocContext * const ctx,
+                         const unsigned int flags)
+{
+  assert(out != NULL);
+  assert(object_name != NULL);
+  assert(*object_name != '\0');
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(info != NULL);
+  assert(vtotal != NULL);
+  assert(*vtotal >= 0);
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  MeshStyle const mstyle = get_mesh_style(flags);
+
+  /* Polygons are formatted locally into a buffer, which is written in one
+     go; 3dObjLib is only needed to split them into triangles or to write
+     lines and points. */
+  if (obj_can_format(group, mstyle)) {
+    ByteBuffer *const text = &ctx->text;
+    byte_buffer_reset(text);
+    if (!format_object(text, object_name, varray, group, info, *vtotal, ctx,
+                       &ctx->arena, flags) ||
+        !write_text(out, text)) {
       return false;
     }
 
-    *vtotal += vobject;
+    *vtotal += info->vobject;
+    return true;
   }
 
-  if (flags & FLAGS_LIST) {
-    if (!*list_title) {
-      puts("\nIndex  Name                  Verts  Prims      Offset        Size");
-      *list_title = true;
+  if (fputs("\no ", out) == EOF || fputs(object_name, out) == EOF ||
+      fputc('\n', out) == EOF) {
+    fprintf(stderr,
+            "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  VertexStyle vstyle = VertexStyle_Positive;
+  if (flags & FLAGS_NEGATIVE_INDICES) {
+    vstyle = VertexStyle_Negative;
+  }
+
+  if (!output_vertices(out, info->vobject, varray, -1) ||
+      !output_primitives(out, object_name, *vtotal, info->vobject,
+                         varray, group, 1,
+                         (flags & FLAGS_FALSE_COLOUR) ? get_false_colour :
+                           (OutputPrimitivesGetColourFn *)NULL,
+                         get_material, ctx, vstyle, mstyle)) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  *vtotal += info->vobject;
+  return true;
+}
+
+/* Writes an object, or keeps it to be written with the others at the end
+   if the output format is binary. */
+static bool output_object(FILE * const out, const char * const object_name,
+                          const int object_count,
+                          const VertexArray * const varray,
+                          const Group * const group,
+                          const ObjectInfo * const info,
+                          int *const vtotal, ApocContext * const ctx,
+                          const unsigned int flags)
+{
+  assert(object_count >= 0);
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  _Optional OutputPrimitivesGetColourFn *const get_colour =
+    (flags & FLAGS_FALSE_COLOUR) ? get_false_colour :
+                                   (OutputPrimitivesGetColourFn *)NULL;
+
+  if (flags & FLAGS_GLB) {
+    return glb_add_object(&ctx->glb, object_name, varray, group, get_colour,
+                          ctx, flags);
+  }
+
+  if (flags & FLAGS_PLY) {
+    return ply_add_object(&ctx->ply, object_count, varray, group,
+                          get_colour, ctx, flags);
+  }
+
+  if (flags & FLAGS_ARCHIVE) {
+    return archive_add_object(&ctx->archive, object_name, object_count,
+                              varray, group, get_colour, ctx, flags);
+  }
+
+  return write_object(out, object_name, varray, group, info, vtotal, ctx,
+                      flags);
+}
+
+static void list_object(const char * const object_name,
+                        const int object_count,
+                        const ApocObjectInfo * const info,
+                        bool *const list_title)
+{
+  assert(object_name != NULL);
+  assert(object_count >= 0);
+  assert(info != NULL);
+  assert(list_title != NULL);
+
+  if (!*list_title) {
+    puts("\nIndex  Name                  Verts  Prims      Offset        Size");
+    *list_title = true;
+  }
+
+  printf("%5d  %-20.20s  %5d  %5d  %10ld  %10ld\n",
+         object_count, object_name, info->nvertices, info->nprimitives,
+         info->file_pos, info->size);
+}
+
+static bool process_object(Input * const r, _Optional FILE * const out,
+                           const char * const object_name,
+                           const int object_count,
+                           VertexArray * const varray,
+                           Group * const group,
+                           int *const vtotal, bool *const list_title,
+                           ApocContext * const ctx,
+                           const unsigned int flags)
+{
+  assert(r != NULL);
+  assert(object_name != NULL);
+  assert(*object_name != '\0');
+  assert(object_count >= 0);
+  assert(!(flags & ~FLAGS_ALL));
+
+  ObjectInfo info;
+  if (!convert_object(r, out != NULL, object_count, varray, group, &info,
+                      &ctx->arena, flags)) {
+    return false;
+  }
+
+  if (out != NULL) {
+    double const start = apoc_stats_start(ctx->stats);
+    bool const success = output_object(&*out, object_name, object_count,
+                                       varray, group, &info, vtotal, ctx,
+                                       flags);
+    apoc_stats_stop(ctx->stats, ApocStage_Output, start);
+    if (!success) {
+      return false;
     }
+  }
 
-    const long int obj_size = reader_ftell(r) - obj_start;
-    printf("%5d  %-20.20s  %5d  %5d  %10ld  %10ld\n",
-           object_count, object_name, nvertices, nprimitives,
-           obj_start, obj_size);
+  if (flags & FLAGS_LIST) {
+    list_object(object_name, object_count, &info.summary, list_title);
   }
 
   return true;
 }
 
-static bool read_index(Reader * const in, const int first, const int last,
+static bool read_index(Input * const in, const int first, const int last,
   const long int index_offset, long int *const index, const unsigned int flags)
 {
   assert(in != NULL);
-  assert(!reader_ferror(in));
   assert(first >= 0);
   assert(last >= first);
   assert(index_offset >= 0);
   assert(index != NULL);
   assert(!(flags & ~FLAGS_ALL));
 
-  int const err = reader_fseek(in, index_offset +
-                               (sizeof(int32_t) * first), SEEK_SET);
-  if (err) {
+  if (!input_seek(in, index_offset + (long int)(sizeof(int32_t) * first))) {
     fprintf(stderr, "Failed to seek objects index at "
                     "file position %ld (0x%lx)\n",
             index_offset, index_offset);
-    return NULL;
+    return false;
   }
 
   bool success = true;
@@ -599,7 +1215,7 @@ static bool read_index(Reader * const in, const int first, const int last,
 
   for (int object_count = first; object_count <= last; ++object_count) {
     int32_t address;
-    if (!reader_fread_int32(&address, in)) {
+    if (!input_read_int32(&address, in)) {
       fprintf(stderr, "Failed to read address from input file (object %d)\n",
               object_count);
       success = false;
@@ -614,6 +1230,15 @@ static bool read_index(Reader * const in, const int first, const int last,
     }
 
     long int const fpos = index_offset + (address - index_addr);
+    /* An object must begin before the end of the input */
+    if (fpos >= in->size) {
+      fprintf(stderr, "Address %" PRId32 " (0x%" PRIx32 ") for object %d "
+              "is beyond the end of the input (file position %ld)\n",
+              address, address, object_count, fpos);
+      success = false;
+      break;
+    }
+
     if (flags & FLAGS_VERBOSE) {
       printf("Object %d has address 0x%" PRIx32 ", "
              "file position %ld (0x%lx)\n",
@@ -624,129 +1249,1794 @@ static bool read_index(Reader * const in, const int first, const int last,
   return success;
 }
 
-static bool process_objects(Reader * const in, _Optional FILE * const out,
-        int const first, int const last, _Optional const char * const name,
-        const long int *const index, const unsigned int flags)
+/* Finds the no. of entries in an index by reading addresses until one is
+   bad or the next entry would overlap the first object. Returns -1 if no
+   entry is valid. */
+static int find_index_size(Input * const in, const long int index_offset,
+                           const unsigned int flags)
 {
   assert(in != NULL);
-  assert(!reader_ferror(in));
-  assert(index != NULL);
-  assert(first >= 0);
-  assert(last >= first);
+  assert(index_offset >= 0);
   assert(!(flags & ~FLAGS_ALL));
 
-  Group group;
-  group_init(&group);
-
-  VertexArray varray;
-  vertex_array_init(&varray);
-
-  bool success = true;
-  int vtotal = 0;
-  bool list_title = false, stop = false;
-
-  /* Read each file position from the index in turn. */
-  for (int object_count = first;
-       success && !stop && (object_count <= last);
-       ++object_count) {
-
-    /* Is this object the named one? */
-    const char *object_name;
-    if (flags & FLAGS_FLATS) {
-      object_name = get_flat_name(object_count);
-    } else {
-      object_name = get_obj_name(object_count);
-    }
+  if (!input_seek(in, index_offset)) {
+    fprintf(stderr, "Failed to seek objects index at "
+                    "file position %ld (0x%lx)\n",
+            index_offset, index_offset);
+    return -1;
+  }
 
-    if (name != NULL) {
-      if (!strcmp(&*name, object_name)) {
-        /* Stop after finding the named object (assuming there are
-           no others of the same name) */
-        stop = true;
-      } else {
-        continue;
-      }
-    }
+  const long int index_addr = LoadAddress + index_offset;
+  long int end = in->size; /* of the index */
+  int count = 0;
 
-    long int const file_pos = index[object_count];
-    int err = reader_fseek(in, file_pos, SEEK_SET);
-    if (!err) {
-      /* fseek doesn't return an error when seeking beyond the end
-         of a file. */
-      const int c = reader_fgetc(in);
-      if (c == EOF) {
-        err = 1;
-      } else {
-        if (reader_ungetc(c, in) == EOF) {
-          fprintf(stderr, "Failed to push back first byte of object %d\n",
-                  object_count);
-          success = false;
-          break;
-        }
-      }
+  while (count < INT_MAX &&
+         (end - index_offset) / (long int)sizeof(int32_t) > count) {
+    int32_t address;
+    if (!input_read_int32(&address, in) || address < index_addr) {
+      break;
     }
 
-    if (err) {
-      fprintf(stderr, "Failed to seek object %d at "
-                      "file position %ld (0x%lx)\n",
-              object_count, file_pos, file_pos);
-      success = false;
+    long int const fpos = index_offset + (address - index_addr);
+    if (fpos >= in->size ||
+        (fpos - index_offset) / (long int)sizeof(int32_t) <= count) {
       break;
     }
 
-    if (flags & FLAGS_VERBOSE) {
-      printf("Found object %d at file position %ld (0x%lx)\n",
-             object_count, file_pos, file_pos);
+    if (fpos < end) {
+      end = fpos;
     }
-
-    success = process_object(in, out, object_name, object_count,
-                             &varray, &group, &vtotal, &list_title,
-                             flags);
+    ++count;
   }
 
-  group_free(&group);
-  vertex_array_free(&varray);
+  if (count == 0) {
+    fprintf(stderr, "No valid addresses in index at file position %ld "
+                    "(0x%lx)\n", index_offset, index_offset);
+    return -1;
+  }
 
-  return success;
+  if (flags & FLAGS_VERBOSE) {
+    printf("Found %d entries in index at file position %ld (0x%lx)\n",
+           count, index_offset, index_offset);
+  }
+  return count;
 }
 
-bool apoc_to_obj(Reader * const in, _Optional FILE * const out,
-                 int first, int last, _Optional const char * const name,
-                 const long int index_offset, const char * const mtl_file,
-                 const unsigned int flags)
+/* Gets the no. of entries in an index, which is found from the index
+   itself if nobjects is 0. Returns -1 on error. */
+static int get_index_size(Input * const in, const long int index_offset,
+                          const int nobjects, const unsigned int flags)
 {
   assert(in != NULL);
-  assert(!reader_ferror(in));
-  assert(first >= 0);
   assert(index_offset >= 0);
-  assert(last == -1 || last >= first);
-  assert(mtl_file != NULL);
+  assert(nobjects >= 0);
   assert(!(flags & ~FLAGS_ALL));
 
-  if (out != NULL &&
-      fprintf(&*out, "# Apocalypse graphics\n"
-                     "# Converted by ApoctoObj "VERSION_STRING"\n"
-                     "mtllib %s\n", mtl_file) < 0) {
-    fprintf(stderr, "Failed writing to output file: %s\n",
-            strerror(errno));
-    return false;
-  }
+  return nobjects > 0 ? nobjects : find_index_size(in, index_offset, flags);
+}
 
-  if (first == -1) {
-    first = 0;
-  }
+/* Allocates an array for n file positions read from an index. */
+static _Optional long int *alloc_index(const int n)
+{
+  assert(n > 0);
 
-  int const max = (flags & FLAGS_FLATS) ? MaxNumFlats : MaxNumObjects;
-  if (last == -1 || last >= max) {
-    last = max - 1;
+  _Optional long int *const index = malloc(sizeof(*index) * (size_t)n);
+  if (index == NULL) {
+    fprintf(stderr, "Failed to allocate memory for an index of %d objects\n",
+            n);
   }
+  return index;
+}
 
+typedef struct {
+  long int file_pos;
+  int object_count;
+} ObjectPos;
+
+static int compare_pos(const void *const a, const void *const b)
+{
+  const ObjectPos *const pa = a, *const pb = b;
+  if (pa->file_pos != pb->file_pos) {
+    return pa->file_pos < pb->file_pos ? -1 : 1;
+  }
+  return pa->object_count - pb->object_count;
+}
+
+/* Sorts the file positions index[first .. last] into order, keeping
+   aliases in order of object number. Returns NULL on failure. */
+static _Optional ObjectPos *sort_index(const long int *const index,
+                                       int const first, int const last)
+{
+  assert(index != NULL);
+  assert(first >= 0);
+  assert(last >= first);
+
+  int const n = last - first + 1;
+  _Optional ObjectPos *const sorted = malloc(sizeof(*sorted) * (size_t)n);
+  if (sorted == NULL) {
+    fputs("Failed to allocate memory to sort the index\n", stderr);
+    return NULL;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    sorted[i].file_pos = index[first + i];
+    sorted[i].object_count = first + i;
+  }
+  qsort(&*sorted, (size_t)n, sizeof(sorted[0]), compare_pos);
+  return sorted;
+}
+
+/* Gets the size of an object from the element counts in its header,
+   without decoding any vertices or primitives. Returns false if the
+   counts can't be read or are bad (the parser will report that). */
+static bool get_object_size(const Input * const in, const long int file_pos,
+                            long int *const size, const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(file_pos >= 0);
+  assert(size != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  long int pos = file_pos;
+  if (in->size - pos < (long int)sizeof(int32_t)) {
+    return false;
+  }
+  const int32_t nvertices = decode_int32(in->data + pos);
+  if ((nvertices < 1) || (nvertices > MaxNumVertices)) {
+    return false;
+  }
+  pos += sizeof(int32_t);
+
+  if (flags & FLAGS_FLATS) {
+    pos += (long int)nvertices * BytesPerFlatVertex;
+  } else {
+    pos += (long int)nvertices * BytesPerVertex;
+    if (in->size - pos < (long int)sizeof(int32_t)) {
+      return false;
+    }
+    const int32_t nprimitives = decode_int32(in->data + pos);
+    if (nprimitives < 1 ||
+        nprimitives > (LONG_MAX - pos) / (BytesPerPrimitive + 1)) {
+      return false;
+    }
+    pos += sizeof(int32_t) + ((long int)nprimitives * (BytesPerPrimitive + 1));
+  }
+
+  *size = pos - file_pos;
+  return true;
+}
+
+/* Checks the extent of each selected object against the end of the input
+   and the start of the next object in file order, before any of them are
+   parsed. */
+static bool check_objects(const Input * const in,
+                          int const first, int const last,
+                          int const sel_first, int const sel_last,
+                          const long int *const index,
+                          const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(first >= 0);
+  assert(last >= first);
+  assert(sel_first >= first);
+  assert(sel_last <= last);
+  assert(index != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  _Optional ObjectPos *const sorted = sort_index(index, first, last);
+  if (sorted == NULL) {
+    return false;
+  }
+
+  bool success = true;
+  int const n = last - first + 1;
+  for (int i = 0; success && i < n; ++i) {
+    int const object_count = sorted[i].object_count;
+    if (object_count < sel_first || object_count > sel_last) {
+      continue;
+    }
+
+    /* Aliases share a file position, so find the next distinct one */
+    long int const file_pos = sorted[i].file_pos;
+    int next = i + 1;
+    while (next < n && sorted[next].file_pos == file_pos) {
+      ++next;
+    }
+    long int const extent = (next < n ? sorted[next].file_pos : in->size) -
+                            file_pos;
+
+    long int size;
+    if (!get_object_size(in, file_pos, &size, flags)) {
+      continue;
+    }
+
+    if (flags & FLAGS_VERBOSE) {
+      printf("Object %d has size %ld and extent %ld\n",
+             object_count, size, extent);
+    }
+
+    if (size > in->size - file_pos) {
+      fprintf(stderr, "Object %d at file position %ld (0x%lx) is truncated "
+              "(%ld bytes, but only %ld bytes remain)\n", object_count,
+              file_pos, file_pos, size, in->size - file_pos);
+      success = false;
+    } else if (size > extent) {
+      /* Not fatal because some objects have missing data */
+      fprintf(stderr, "Warning: object %d at file position %ld (0x%lx) "
+              "overlaps object %d\n", object_count, file_pos, file_pos,
+              sorted[next].object_count);
+    }
+  }
+
+  free(sorted);
+  return success;
+}
+
+/* Output for an object can be reused if its data, name and all flags
+   affecting its conversion are the same. False colours depend on earlier
+   objects, so they prevent reuse. */
+static bool can_reuse(const ApocContext * const ctx,
+                      const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+  return ctx->fragment_dir != NULL && !(flags & FLAGS_FALSE_COLOUR);
+}
+
+/* Makes the key under which the output for an object is cached.
+   Returns false if the object's data can't be found. */
+static bool get_fragment_key(const Input * const in, const long int file_pos,
+                             const char * const object_name,
+                             const char * const mtl_file,
+                             char * const key, size_t const key_size,
+                             const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(file_pos >= 0);
+  assert(object_name != NULL);
+  assert(mtl_file != NULL);
+  assert(key != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  long int size;
+  if (!get_object_size(in, file_pos, &size, flags) ||
+      size > in->size - file_pos) {
+    return false;
+  }
+
+  int const len = snprintf(key, key_size,
+                           "%016" PRIx64 " %x %s %s " VERSION_STRING,
+                           cache_hash(in->data + file_pos, (size_t)size),
+                           flags & ~(FLAGS_VERBOSE | FLAGS_LIST),
+                           object_name, mtl_file);
+
+  return len >= 0 && (size_t)len < key_size;
+}
+
+/* Formats the output for an object into a fragment, if obj_can_format()
+   returned true for it, with vertex indices numbered as if it were the
+   first object. Only false colours change the context, so unless they
+   are used this can be called on any thread with its own arena. */
+static bool format_fragment(const char * const object_name,
+                            const VertexArray * const varray,
+                            const Group * const group,
+                            const ObjectInfo * const info,
+                            Fragment * const frag,
+                            ApocContext * const ctx, Arena * const arena,
+                            const unsigned int flags)
+{
+  assert(info != NULL);
+  assert(frag != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  byte_buffer_reset(&frag->text);
+  frag->vobject = info->vobject;
+  frag->summary = info->summary;
+  return format_object(&frag->text, object_name, varray, group, info, 0,
+                       ctx, arena, flags);
+}
+
+/* Writes the output for an object into a fragment, with vertex indices
+   numbered as if it were the first object. */
+static bool render_fragment(const char * const object_name,
+                            const VertexArray * const varray,
+                            const Group * const group,
+                            const ObjectInfo * const info,
+                            Fragment * const frag,
+                            ApocContext * const ctx,
+                            const unsigned int flags)
+{
+  assert(object_name != NULL);
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(info != NULL);
+  assert(frag != NULL);
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (obj_can_format(group, get_mesh_style(flags))) {
+    return format_fragment(object_name, varray, group, info, frag, ctx,
+                           &ctx->arena, flags);
+  }
+
+  byte_buffer_reset(&frag->text);
+  frag->vobject = info->vobject;
+  frag->summary = info->summary;
+
+  /* Output that only 3dObjLib can produce goes through a scratch file */
+  if (ctx->scratch == NULL) {
+    ctx->scratch = tmpfile();
+    if (ctx->scratch == NULL) {
+      fprintf(stderr, "Failed to create temporary file: %s\n",
+              strerror(errno));
+      return false;
+    }
+  }
+
+  FILE *const scratch = &*ctx->scratch;
+  rewind(scratch);
+
+  int vtotal = 0;
+  if (!write_object(scratch, object_name, varray, group, info, &vtotal, ctx,
+                    flags)) {
+    return false;
+  }
+
+  long int const len = ftell(scratch);
+  if (len < 0) {
+    fprintf(stderr, "Failed to get size of temporary file: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  _Optional unsigned char *const text = byte_buffer_extend(&frag->text,
+                                                           (size_t)len);
+  if (text == NULL) {
+    return false;
+  }
+
+  rewind(scratch);
+  if (fread(&*text, 1, (size_t)len, scratch) != (size_t)len) {
+    fprintf(stderr, "Failed to read temporary file: %s\n",
+            strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+/* Copies one line of a fragment, adding offset to every vertex index. */
+static bool write_renumbered_line(FILE * const out, const char * const line,
+                                  size_t const len, int const offset)
+{
+  assert(out != NULL);
+  assert(line != NULL);
+
+  size_t start = 0;
+  for (size_t i = 1; i < len; ++i) {
+    if (line[i - 1] != ' ' || !isdigit((unsigned char)line[i])) {
+      continue;
+    }
+
+    if (fwrite(line + start, 1, i - start, out) != i - start) {
+      return false;
+    }
+
+    long int v = 0;
+    while (i < len && isdigit((unsigned char)line[i])) {
+      v = (v * 10) + (line[i++] - '0');
+    }
+    if (fprintf(out, "%ld", v + offset) < 0) {
+      return false;
+    }
+    start = i;
+  }
+
+  return fwrite(line + start, 1, len - start, out) == len - start;
+}
+
+/* Writes the output for an object, adjusting positive vertex indices in
+   elements to account for the vertices of objects already written. */
+static bool write_fragment(FILE * const out, const Fragment * const frag,
+                           int *const vtotal, const unsigned int flags)
+{
+  assert(out != NULL);
+  assert(frag != NULL);
+  assert(vtotal != NULL);
+  assert(*vtotal >= 0);
+  assert(!(flags & ~FLAGS_ALL));
+
+  const char *const text = frag->text.len ?
+                           (const char *)&*frag->text.data : "";
+  size_t const text_len = frag->text.len;
+  int const offset = (flags & FLAGS_NEGATIVE_INDICES) ? 0 : *vtotal;
+  bool success = true;
+
+  if (offset == 0) {
+    success = fwrite(text, 1, text_len, out) == text_len;
+  } else {
+    for (size_t pos = 0; success && pos < text_len; ) {
+      const char *const line = text + pos;
+      _Optional const char *const nl = memchr(line, '\n', text_len - pos);
+      size_t const len = nl != NULL ? (size_t)(&*nl - line) + 1 :
+                                      text_len - pos;
+
+      if (len > 2 && line[1] == ' ' &&
+          (line[0] == 'f' || line[0] == 'l' || line[0] == 'p')) {
+        success = write_renumbered_line(out, line, len, offset);
+      } else {
+        success = fwrite(line, 1, len, out) == len;
+      }
+      pos += len;
+    }
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  *vtotal += frag->vobject;
+  return true;
+}
+
+/* Copies one line of a fragment, replacing each vertex index with the
+   index of the corresponding vertex in the output. Reports an error if the
+   line refers to a vertex that isn't in the object. */
+static bool write_mapped_line(FILE * const out, const char * const line,
+                              size_t const len, const int * const map,
+                              int const nv, int const vtotal,
+                              const unsigned int flags)
+{
+  assert(out != NULL);
+  assert(line != NULL);
+  assert(map != NULL);
+  assert(nv >= 0);
+  assert(vtotal >= 0);
+  assert(!(flags & ~FLAGS_ALL));
+
+  size_t start = 0;
+  for (size_t i = 1; i < len; ++i) {
+    if (line[i - 1] != ' ') {
+      continue;
+    }
+
+    size_t j = i;
+    bool const negative = line[j] == '-';
+    if (negative) {
+      ++j;
+    }
+    if (j >= len || !isdigit((unsigned char)line[j])) {
+      continue;
+    }
+
+    long int v = 0;
+    while (j < len && isdigit((unsigned char)line[j]) && v <= nv) {
+      v = (v * 10) + (line[j++] - '0');
+    }
+
+    /* Negative indices are relative to the end of the object's vertices */
+    long int const local = negative ? nv + 1 - v : v;
+    if (local < 1 || local > nv) {
+      fprintf(stderr, "Bad vertex index %s%ld in object output\n",
+              negative ? "-" : "", v);
+      return false;
+    }
+
+    long int const index = (flags & FLAGS_NEGATIVE_INDICES) ?
+                           map[local] - (long int)vtotal - 1 : map[local];
+
+    if (fwrite(line + start, 1, i - start, out) != i - start ||
+        fprintf(out, "%ld", index) < 0) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      return false;
+    }
+    start = i = j;
+  }
+
+  if (fwrite(line + start, 1, len - start, out) != len - start) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+/* Records the vertices of an object which were written to the output
+   rather than found among those of earlier frames. */
+static bool add_shared_vertices(const Fragment * const frag,
+                                const int * const map, int const vstart,
+                                SharedVertices * const shared)
+{
+  assert(frag != NULL);
+  assert(map != NULL);
+  assert(vstart >= 0);
+  assert(shared != NULL);
+
+  const char *const text = frag->text.len ?
+                           (const char *)&*frag->text.data : "";
+  size_t const text_len = frag->text.len;
+  int nv = 0;
+
+  for (size_t pos = 0; pos < text_len; ) {
+    const char *const line = text + pos;
+    _Optional const char *const nl = memchr(line, '\n', text_len - pos);
+    size_t const len = nl != NULL ? (size_t)(&*nl - line) + 1 :
+                                    text_len - pos;
+
+    if (len > 2 && line[0] == 'v' && line[1] == ' ' && nv < frag->vobject) {
+      int const index = map[++nv];
+      if (index > vstart && !shared_vertices_add(shared, line, len, index)) {
+        fputs("Failed to allocate memory for shared vertices\n", stderr);
+        return false;
+      }
+    }
+    pos += len;
+  }
+  return true;
+}
+
+/* Writes the output for an object, omitting vertices identical to those
+   already written for earlier frames of the same model and referring to
+   those vertices instead. */
+static bool write_shared_fragment(FILE * const out,
+                                  const Fragment * const frag,
+                                  int const object_count, int *const vtotal,
+                                  ApocContext * const ctx,
+                                  const unsigned int flags)
+{
+  assert(out != NULL);
+  assert(frag != NULL);
+  assert(object_count >= 0);
+  assert(vtotal != NULL);
+  assert(*vtotal >= 0);
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int const model = (flags & FLAGS_FLATS) ? -1 : get_obj_model(object_count);
+  if (model < 0 || model != ctx->shared_model) {
+    shared_vertices_reset(&ctx->shared);
+  }
+  ctx->shared_model = model;
+
+  _Optional int *const map = arena_alloc(&ctx->arena, sizeof(*map) *
+                                        ((size_t)frag->vobject + 1));
+  if (map == NULL) {
+    fputs("Failed to allocate memory for vertex map\n", stderr);
+    return false;
+  }
+
+  const char *const text = frag->text.len ?
+                           (const char *)&*frag->text.data : "";
+  size_t const text_len = frag->text.len;
+  int const vstart = *vtotal;
+  int nv = 0;
+
+  /* Vertices are only shared with earlier frames, so that any duplicate
+     vertices within this frame (e.g. with -duplicate) are kept */
+  for (size_t pos = 0; pos < text_len; ) {
+    const char *const line = text + pos;
+    _Optional const char *const nl = memchr(line, '\n', text_len - pos);
+    size_t const len = nl != NULL ? (size_t)(&*nl - line) + 1 :
+                                    text_len - pos;
+
+    if (len > 2 && line[1] == ' ' &&
+        (line[0] == 'f' || line[0] == 'l' || line[0] == 'p')) {
+      if (!write_mapped_line(out, line, len, &*map, nv, *vtotal, flags)) {
+        return false;
+      }
+    } else {
+      int index = 0;
+      bool const vertex = len > 2 && line[0] == 'v' && line[1] == ' ' &&
+                          nv < frag->vobject;
+      if (vertex) {
+        index = shared_vertices_find(&ctx->shared, line, len);
+      }
+      if (index == 0) {
+        if (fwrite(line, 1, len, out) != len) {
+          fprintf(stderr, "Failed writing to output file: %s\n",
+                  strerror(errno));
+          return false;
+        }
+        if (vertex) {
+          index = ++*vtotal;
+        }
+      }
+      if (vertex) {
+        map[++nv] = index;
+      }
+    }
+    pos += len;
+  }
+
+  return model < 0 || add_shared_vertices(frag, &*map, vstart, &ctx->shared);
+}
+
+/* Output for an object goes through a fragment if it is to be reused or
+   post-processed. Fragments are OBJ-format text, so they aren't used for
+   binary output. */
+static bool use_fragments(const ApocContext * const ctx,
+                          const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+  if (flags & FLAGS_BINARY) {
+    return false;
+  }
+  return can_reuse(ctx, flags) || (flags & FLAGS_SHARE_VERTICES);
+}
+
+static bool output_fragment(FILE * const out, const Fragment * const frag,
+                            int const object_count, int *const vtotal,
+                            ApocContext * const ctx,
+                            const unsigned int flags)
+{
+  assert(!(flags & ~FLAGS_ALL));
+  return (flags & FLAGS_SHARE_VERTICES) ?
+    write_shared_fragment(out, frag, object_count, vtotal, ctx, flags) :
+    write_fragment(out, frag, vtotal, flags);
+}
+
+/* As process_object, but via a fragment of output which is reused from a
+   previous conversion if possible, and otherwise saved for reuse. */
+static bool process_object_fragment(Input * const r, FILE * const out,
+                                  const char * const object_name,
+                                  const int object_count,
+                                  int *const vtotal, bool *const list_title,
+                                  const char * const mtl_file,
+                                  ApocContext * const ctx,
+                                  const unsigned int flags)
+{
+  assert(r != NULL);
+  assert(out != NULL);
+  assert(object_name != NULL);
+  assert(object_count >= 0);
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  /* The fragment's text buffer is kept for the next object */
+  Fragment frag;
+  fragment_init(&frag);
+  frag.text = ctx->fragment_text;
+
+  long int const file_pos = input_tell(r);
+  char key[MaxFragmentKeyLen + 1];
+  bool const keyed = can_reuse(ctx, flags) &&
+                     get_fragment_key(r, file_pos, object_name, mtl_file,
+                                      key, sizeof(key), flags);
+  bool success = true;
+
+  if (keyed && fragment_load(&*ctx->fragment_dir, key, &frag)) {
+    frag.summary.file_pos = file_pos;
+  } else {
+    ObjectInfo info;
+    success = convert_object(r, true, object_count, &ctx->varray,
+                             &ctx->group, &info, &ctx->arena, flags);
+    if (success) {
+      double const start = apoc_stats_start(ctx->stats);
+      success = render_fragment(object_name, &ctx->varray, &ctx->group,
+                                &info, &frag, ctx, flags);
+      apoc_stats_stop(ctx->stats, ApocStage_Output, start);
+    }
+
+    /* Failure to save the output for reuse isn't fatal */
+    if (success && keyed) {
+      (void)fragment_save(&*ctx->fragment_dir, key, &frag);
+    }
+  }
+
+  if (success) {
+    double const start = apoc_stats_start(ctx->stats);
+    success = output_fragment(out, &frag, object_count, vtotal, ctx, flags);
+    apoc_stats_stop(ctx->stats, ApocStage_Output, start);
+  }
+
+  if (success && (flags & FLAGS_LIST)) {
+    list_object(object_name, object_count, &frag.summary, list_title);
+  }
+
+  ctx->fragment_text = frag.text;
+  return success;
+}
+
+typedef struct {
+  VertexArray varray;
+  Group group;
+  ObjectInfo info;
+  Fragment frag;
+  Arena arena; /* for planes and vertex numbers, reset for each object */
+  ApocStats stats;
+  int vtotal; /* no. of vertices output before the object */
+  bool reused; /* frag holds output from a previous conversion */
+  bool formatted; /* frag holds output formatted by the job */
+  bool success;
+} ObjectJob;
+
+typedef struct {
+  const Input *in;
+  const long int *index;
+  int first;
+  ObjectJob *jobs;
+  ApocContext *ctx;
+  bool format; /* jobs may format their own output */
+  bool fragments; /* output is formatted as fragments */
+  unsigned int flags;
+} ObjectBatch;
+
+enum {
+  ObjectsPerThread = 16, /* no. of objects held in memory for each thread */
+};
+
+static bool object_job(void * const arg, int const job)
+{
+  ObjectBatch *const batch = arg;
+  assert(batch != NULL);
+  assert(job >= 0);
+
+  ObjectJob *const object = &batch->jobs[job];
+  int const object_count = batch->first + job;
+
+  if (object->reused) {
+    object->success = true;
+    return true;
+  }
+
+  char buffer[NameBufferSize];
+  const char *const object_name = (batch->flags & FLAGS_FLATS) ?
+    get_flat_name(object_count, buffer, sizeof(buffer)) :
+    get_obj_name(object_count, buffer, sizeof(buffer));
+
+  /* Each job has its own read position and statistics */
+  Input in = *batch->in;
+  if (in.stats != NULL) {
+    in.stats = &object->stats;
+  }
+  double const start = apoc_stats_start(in.stats);
+  arena_reset(&object->arena);
+  object->success = input_seek(&in, batch->index[object_count]) &&
+                    convert_object(&in, true, object_count, &object->varray,
+                                   &object->group, &object->info,
+                                   &object->arena, batch->flags);
+
+  if (object->success && batch->format && batch->fragments &&
+      obj_can_format(&object->group, get_mesh_style(batch->flags))) {
+    double const output_start = apoc_stats_start(in.stats);
+    object->success = format_fragment(object_name, &object->varray,
+                                      &object->group, &object->info,
+                                      &object->frag, batch->ctx,
+                                      &object->arena, batch->flags);
+    object->formatted = object->success;
+    apoc_stats_stop(in.stats, ApocStage_Output, output_start);
+  }
+
+  if (object->stats.trace != NULL) {
+    apoc_stats_span(in.stats, "object", object_name, object_count, start);
+  }
+  return object->success;
+}
+
+/* Formats the output for a converted object, once the no. of vertices
+   output before it is known. */
+static bool format_job(void * const arg, int const job)
+{
+  ObjectBatch *const batch = arg;
+  assert(batch != NULL);
+  assert(job >= 0);
+
+  ObjectJob *const object = &batch->jobs[job];
+  int const object_count = batch->first + job;
+
+  if (!object->success) {
+    return false;
+  }
+
+  if (!obj_can_format(&object->group, get_mesh_style(batch->flags))) {
+    return true;
+  }
+
+  char buffer[NameBufferSize];
+  const char *const object_name = (batch->flags & FLAGS_FLATS) ?
+    get_flat_name(object_count, buffer, sizeof(buffer)) :
+    get_obj_name(object_count, buffer, sizeof(buffer));
+
+  _Optional ApocStats *const stats = batch->ctx->stats != NULL ?
+                                     &object->stats : NULL;
+  double const start = apoc_stats_start(stats);
+  byte_buffer_reset(&object->frag.text);
+  object->success = format_object(&object->frag.text, object_name,
+                                  &object->varray, &object->group,
+                                  &object->info, object->vtotal, batch->ctx,
+                                  &object->arena, batch->flags);
+  object->formatted = object->success;
+  apoc_stats_stop(stats, ApocStage_Output, start);
+  return object->success;
+}
+
+/* Converts objects first .. first+nobjects-1 using one job each, then
+   writes them in index order. */
+static bool process_object_batch(const Input * const in, FILE * const out,
+        int const first, int const nobjects, const long int *const index,
+        int const njobs, const char * const mtl_file,
+        ObjectJob * const jobs, int *const vtotal,
+        ApocContext * const ctx, const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(out != NULL);
+  assert(first >= 0);
+  assert(nobjects > 0);
+  assert(index != NULL);
+  assert(njobs > 1);
+  assert(jobs != NULL);
+  assert(vtotal != NULL);
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  bool const reuse = can_reuse(ctx, flags);
+  for (int j = 0; j < nobjects; ++j) {
+    apoc_stats_init(&jobs[j].stats);
+    if (ctx->stats != NULL) {
+      jobs[j].stats.trace = ctx->stats->trace;
+    }
+    jobs[j].reused = false;
+    jobs[j].formatted = false;
+    jobs[j].success = false;
+  }
+
+  /* Only objects without reusable output need to be converted */
+  for (int j = 0; reuse && j < nobjects; ++j) {
+    int const object_count = first + j;
+    char buffer[NameBufferSize], key[MaxFragmentKeyLen + 1];
+    const char *const object_name = (flags & FLAGS_FLATS) ?
+      get_flat_name(object_count, buffer, sizeof(buffer)) :
+      get_obj_name(object_count, buffer, sizeof(buffer));
+
+    jobs[j].reused = get_fragment_key(in, index[object_count], object_name,
+                                      mtl_file, key, sizeof(key), flags) &&
+                     fragment_load(&*ctx->fragment_dir, key, &jobs[j].frag);
+  }
+
+  /* False colours are assigned in order, so the output must be formatted
+     serially; otherwise the context is only read by the jobs. */
+  bool const fragments = use_fragments(ctx, flags);
+  ObjectBatch batch = {
+    .in = in,
+    .index = index,
+    .first = first,
+    .jobs = jobs,
+    .ctx = ctx,
+    .format = !(flags & (FLAGS_BINARY | FLAGS_FALSE_COLOUR)),
+    .fragments = fragments,
+    .flags = flags,
+  };
+
+  bool started = jobs_run(njobs, nobjects, object_job, &batch);
+
+  /* Output other than fragments is formatted with its final vertex
+     numbers, which depend on the size of every earlier object */
+  if (batch.format && !fragments) {
+    int v = *vtotal;
+    for (int j = 0; j < nobjects && jobs[j].success; ++j) {
+      jobs[j].vtotal = v;
+      v += jobs[j].info.vobject;
+    }
+    started = jobs_run(njobs, nobjects, format_job, &batch) && started;
+  }
+
+  if (!started) {
+    fputs("Warning: failed to start all worker threads\n", stderr);
+  }
+
+  if (ctx->stats != NULL) {
+    for (int j = 0; j < nobjects; ++j) {
+      apoc_stats_add(&*ctx->stats, &jobs[j].stats);
+    }
+  }
+
+  /* Stop at the first object that failed, as if converting serially */
+  bool success = true;
+  for (int j = 0; success && j < nobjects; ++j) {
+    int const object_count = first + j;
+    char buffer[NameBufferSize];
+    const char *const object_name = (flags & FLAGS_FLATS) ?
+      get_flat_name(object_count, buffer, sizeof(buffer)) :
+      get_obj_name(object_count, buffer, sizeof(buffer));
+
+    success = jobs[j].success;
+    if (!success) {
+      break;
+    }
+
+    arena_reset(&ctx->arena);
+    double const start = apoc_stats_start(ctx->stats);
+    if (!fragments && jobs[j].formatted) {
+      assert(jobs[j].vtotal == *vtotal);
+      success = write_text(out, &jobs[j].frag.text);
+      *vtotal += jobs[j].info.vobject;
+    } else if (fragments) {
+      if (!jobs[j].reused && !jobs[j].formatted) {
+        success = render_fragment(object_name, &jobs[j].varray,
+                                  &jobs[j].group, &jobs[j].info,
+                                  &jobs[j].frag, ctx, flags);
+      }
+
+      success = success && output_fragment(out, &jobs[j].frag, object_count,
+                                           vtotal, ctx, flags);
+
+      /* Failure to save the output for reuse isn't fatal */
+      char key[MaxFragmentKeyLen + 1];
+      if (success && reuse && !jobs[j].reused &&
+          get_fragment_key(in, index[object_count], object_name, mtl_file,
+                           key, sizeof(key), flags)) {
+        (void)fragment_save(&*ctx->fragment_dir, key, &jobs[j].frag);
+      }
+    } else {
+      success = output_object(out, object_name, object_count,
+                              &jobs[j].varray, &jobs[j].group,
+                              &jobs[j].info, vtotal, ctx, flags);
+    }
+    apoc_stats_stop(ctx->stats, ApocStage_Output, start);
+  }
+
+  return success;
+}
+
+/* Converts objects on up to njobs threads, then writes them in index order
+   so that the output is identical to converting them one at a time. Only
+   a few objects per thread are held in memory at once. */
+static bool process_objects_parallel(const Input * const in, FILE * const out,
+        int const first, int const last, const long int *const index,
+        int const njobs, const char * const mtl_file,
+        ApocContext * const ctx, const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(out != NULL);
+  assert(first >= 0);
+  assert(last >= first);
+  assert(index != NULL);
+  assert(njobs > 1);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int njobs_held = last - first + 1;
+  if (njobs_held / ObjectsPerThread > njobs) {
+    njobs_held = njobs * ObjectsPerThread;
+  }
+
+  _Optional ObjectJob *const jobs = malloc(sizeof(*jobs) *
+                                           (size_t)njobs_held);
+  if (jobs == NULL) {
+    fputs("Failed to allocate memory for object jobs\n", stderr);
+    return false;
+  }
+
+  for (int j = 0; j < njobs_held; ++j) {
+    vertex_array_init(&jobs[j].varray);
+    group_init(&jobs[j].group);
+    fragment_init(&jobs[j].frag);
+    arena_init(&jobs[j].arena);
+  }
+
+  bool success = true;
+  int vtotal = 0;
+  for (int batch_first = first; success && batch_first <= last;
+       batch_first += njobs_held) {
+    int const nobjects = last - batch_first + 1 < njobs_held ?
+                         last - batch_first + 1 : njobs_held;
+
+    success = process_object_batch(in, out, batch_first, nobjects, index,
+                                   njobs, mtl_file, &*jobs, &vtotal, ctx,
+                                   flags);
+  }
+
+  for (int j = 0; j < njobs_held; ++j) {
+    arena_free(&jobs[j].arena);
+    fragment_free(&jobs[j].frag);
+    group_free(&jobs[j].group);
+    vertex_array_free(&jobs[j].varray);
+  }
+  free(jobs);
+
+  return success;
+}
+
+/* Narrows the range first..last to the named object, if any. Returns false
+   if the named object isn't in the range. */
+static bool select_objects(_Optional const char * const name,
+                           int *const first, int *const last,
+                           const unsigned int flags)
+{
+  assert(first != NULL);
+  assert(last != NULL);
+  assert(*first >= 0);
+  assert(*last >= *first);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (name == NULL) {
+    return true;
+  }
+
+  /* Look up the named object (assuming there are no others of the same
+     name) */
+  int const object_count = (flags & FLAGS_FLATS) ?
+    get_flat_index(&*name) : get_obj_index(&*name);
+
+  if (object_count < *first || object_count > *last) {
+    return false;
+  }
+  *first = *last = object_count;
+  return true;
+}
+
+static bool process_objects(Input * const in, _Optional FILE * const out,
+        int const first, int const last, _Optional const char * const name,
+        const long int *const index, int const njobs,
+        const char * const mtl_file, ApocContext * const ctx,
+        const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(index != NULL);
+  assert(first >= 0);
+  assert(last >= first);
+  assert(!(flags & ~FLAGS_ALL));
+
+  int sel_first = first, sel_last = last;
+  if (!select_objects(name, &sel_first, &sel_last, flags)) {
+    return true;
+  }
+
+  if (!check_objects(in, first, last, sel_first, sel_last, index, flags)) {
+    return false;
+  }
+
+  /* Listing is cheap and debug output would be interleaved */
+  if (out != NULL && njobs > 1 && sel_last > sel_first &&
+      !(flags & (FLAGS_LIST | FLAGS_VERBOSE))) {
+    return process_objects_parallel(in, &*out, sel_first, sel_last, index,
+                                    njobs, mtl_file, ctx, flags);
+  }
+
+  bool success = true;
+  int vtotal = 0;
+  bool list_title = false;
+
+  /* Read each file position from the index in turn. */
+  for (int object_count = sel_first;
+       success && (object_count <= sel_last);
+       ++object_count) {
+
+    char buffer[NameBufferSize];
+    const char *object_name;
+    if (flags & FLAGS_FLATS) {
+      object_name = get_flat_name(object_count, buffer, sizeof(buffer));
+    } else {
+      object_name = get_obj_name(object_count, buffer, sizeof(buffer));
+    }
+
+    /* Positions were range-checked when the index was read */
+    long int const file_pos = index[object_count];
+    if (!input_seek(in, file_pos)) {
+      fprintf(stderr, "Failed to seek object %d at "
+                      "file position %ld (0x%lx)\n",
+              object_count, file_pos, file_pos);
+      success = false;
+      break;
+    }
+
+    if (flags & FLAGS_VERBOSE) {
+      printf("Found object %d at file position %ld (0x%lx)\n",
+             object_count, file_pos, file_pos);
+    }
+
+    arena_reset(&ctx->arena);
+    double const start = apoc_stats_start(ctx->stats);
+    if (out != NULL && use_fragments(ctx, flags)) {
+      success = process_object_fragment(in, &*out, object_name, object_count,
+                                      &vtotal, &list_title, mtl_file, ctx,
+                                      flags);
+    } else {
+      success = process_object(in, out, object_name, object_count,
+                               &ctx->varray, &ctx->group, &vtotal,
+                               &list_title, ctx, flags);
+    }
+    apoc_stats_span(ctx->stats, "object", object_name, object_count, start);
+  }
+
+  return success;
+}
+
+long int apoc_default_index_offset(const unsigned int flags)
+{
+  assert(!(flags & ~FLAGS_ALL));
+  return ((flags & FLAGS_FLATS) ? FlatIndexAddress : MeshIndexAddress) -
+         LoadAddress;
+}
+
+int apoc_count_objects(const void * const data, const size_t size,
+                       const long int index_offset, const int nobjects,
+                       const unsigned int flags)
+{
+  assert(data != NULL || size == 0);
+  assert(index_offset >= 0);
+  assert(nobjects >= 0);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (size > LONG_MAX) {
+    fputs("Input is too big\n", stderr);
+    return -1;
+  }
+
+  Input in = {
+    .data = data,
+    .size = (long int)size,
+    .pos = 0,
+  };
+
+  return get_index_size(&in, index_offset, nobjects, flags);
+}
+
+/* Substitutes defaults for an unspecified first or last object, given the
+   no. of objects in the index. Returns false if the first object isn't in
+   the index. */
+static bool get_range(int *const first, int *const last, int const nobjects)
+{
+  assert(first != NULL);
+  assert(last != NULL);
+  assert(nobjects > 0);
+
+  if (*first == -1) {
+    *first = 0;
+  }
+
+  if (*first >= nobjects) {
+    fprintf(stderr, "First object number %d is beyond the end of "
+                    "the index (%d objects)\n", *first, nobjects);
+    return false;
+  }
+
+  if (*last == -1 || *last >= nobjects) {
+    *last = nobjects - 1;
+  }
+  return true;
+}
+
+void apoc_context_init(ApocContext * const ctx)
+{
+  assert(ctx != NULL);
+  vertex_array_init(&ctx->varray);
+  group_init(&ctx->group);
+  ctx->materials = NULL;
+  ctx->material_flags = 0;
+  ctx->false_colour_count = 0;
+  ctx->fragment_dir = NULL;
+  ctx->scratch = NULL;
+  shared_vertices_init(&ctx->shared);
+  ctx->shared_model = -1;
+  glb_init(&ctx->glb);
+  ply_init(&ctx->ply);
+  archive_init(&ctx->archive);
+  ctx->stats = NULL;
+  arena_init(&ctx->arena);
+  byte_buffer_init(&ctx->text);
+  byte_buffer_init(&ctx->fragment_text);
+}
+
+void apoc_context_free(ApocContext * const ctx)
+{
+  assert(ctx != NULL);
+  group_free(&ctx->group);
+  vertex_array_free(&ctx->varray);
+  free(ctx->materials);
+  ctx->materials = NULL;
+  shared_vertices_free(&ctx->shared);
+  glb_free(&ctx->glb);
+  ply_free(&ctx->ply);
+  archive_free(&ctx->archive);
+  arena_free(&ctx->arena);
+  byte_buffer_free(&ctx->text);
+  byte_buffer_free(&ctx->fragment_text);
+  if (ctx->scratch != NULL) {
+    fclose(&*ctx->scratch);
+    ctx->scratch = NULL;
+  }
+}
+
+/* Material names depend only on the flags, so a context reformats them
+   only when the flags which affect them change. */
+static bool ctx_get_materials(ApocContext * const ctx,
+                              const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  const unsigned int material_flags = flags & FLAGS_HUMAN_READABLE;
+  if (ctx->materials != NULL && ctx->material_flags == material_flags) {
+    return true;
+  }
+
+  if (ctx->materials == NULL) {
+    ctx->materials = malloc(sizeof(*ctx->materials));
+    if (ctx->materials == NULL) {
+      fputs("Failed to allocate memory for material names\n", stderr);
+      return false;
+    }
+  }
+
+  if (!materials_init(&*ctx->materials, flags)) {
+    free(ctx->materials);
+    ctx->materials = NULL;
+    return false;
+  }
+  ctx->material_flags = material_flags;
+  return true;
+}
+
+bool apoc_to_obj_ctx(ApocContext * const ctx,
+                     const void * const data, const size_t size,
+                     _Optional FILE * const out,
+                     int first, int last, _Optional const char * const name,
+                     const long int index_offset, const int nobjects,
+                     const char * const mtl_file,
+                     const int njobs, const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(data != NULL || size == 0);
+  assert(njobs >= 1);
+  assert(first >= 0);
+  assert(index_offset >= 0);
+  assert(nobjects >= 0);
+  assert(last == -1 || last >= first);
+  assert(mtl_file != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (size > LONG_MAX) {
+    fputs("Input is too big\n", stderr);
+    return false;
+  }
+
+  Input in = {
+    .data = data,
+    .size = (long int)size,
+    .pos = 0,
+    .stats = ctx->stats,
+  };
+
+  if (out != NULL && !(flags & FLAGS_BINARY) &&
+      fprintf(&*out, "# Apocalypse graphics\n"
+                     "# Converted by ApoctoObj "VERSION_STRING"\n"
+                     "mtllib %s\n", mtl_file) < 0) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  ctx->false_colour_count = 0;
+  shared_vertices_reset(&ctx->shared);
+  ctx->shared_model = -1;
+  glb_reset(&ctx->glb);
+  ply_reset(&ctx->ply);
+  archive_reset(&ctx->archive);
+  if (out != NULL && !ctx_get_materials(ctx, flags)) {
+    return false;
+  }
+
+  double start = apoc_stats_start(ctx->stats);
+  int const count = get_index_size(&in, index_offset, nobjects, flags);
+  if (count < 0 || !get_range(&first, &last, count)) {
+    return false;
+  }
+
+  _Optional long int *const index = alloc_index(last + 1);
+  if (index == NULL) {
+    return false;
+  }
+
+  bool const indexed = read_index(&in, first, last, index_offset, &*index,
+                                  flags);
+  apoc_stats_stop(ctx->stats, ApocStage_ReadIndex, start);
+
+  bool success = false;
+  if (indexed) {
+    success = process_objects(&in, out, first, last, name, &*index,
+                              njobs, mtl_file, ctx, flags);
+  }
+  free(index);
+
+  start = apoc_stats_start(ctx->stats);
+  if (success && out != NULL && (flags & FLAGS_GLB)) {
+    success = glb_write(&ctx->glb, &*out, get_material, ctx);
+  }
+
+  if (success && out != NULL && (flags & FLAGS_PLY)) {
+    success = ply_write(&ctx->ply, &*out);
+  }
+
+  if (success && out != NULL && (flags & FLAGS_ARCHIVE)) {
+    success = archive_write(&ctx->archive, &*out);
+  }
+  if (out != NULL && (flags & FLAGS_BINARY)) {
+    apoc_stats_stop(ctx->stats, ApocStage_Output, start);
+  }
+
+  return success;
+}
+
+bool apoc_scan_ctx(ApocContext * const ctx,
+                   const void * const data, const size_t size,
+                   const long int index_offset, const int nobjects,
+                   ApocObjectInfo * const objects,
+                   const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(data != NULL || size == 0);
+  assert(index_offset >= 0);
+  assert(nobjects > 0);
+  assert(objects != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (size > LONG_MAX) {
+    fputs("Input is too big\n", stderr);
+    return false;
+  }
+
+  Input in = {
+    .data = data,
+    .size = (long int)size,
+    .pos = 0,
+  };
+
+  int const last = nobjects - 1;
+  _Optional long int *const index = alloc_index(nobjects);
+  if (index == NULL) {
+    return false;
+  }
+
+  bool success = read_index(&in, 0, last, index_offset, &*index, flags) &&
+                 check_objects(&in, 0, last, 0, last, &*index, flags);
+
+  /* Objects are parsed to validate them but not prepared for output */
+  for (int object_count = 0; success && object_count <= last;
+       ++object_count) {
+    ObjectInfo info;
+    success = input_seek(&in, index[object_count]) &&
+              convert_object(&in, false, object_count, &ctx->varray,
+                             &ctx->group, &info, NULL, flags);
+    if (success) {
+      objects[object_count] = info.summary;
+    }
+  }
+
+  free(index);
+  return success;
+}
+
+bool apoc_read_index(const void * const data, const size_t size,
+                     const long int index_offset, const int first,
+                     const int last, long int * const index,
+                     const unsigned int flags)
+{
+  assert(data != NULL || size == 0);
+  assert(index_offset >= 0);
+  assert(first >= 0);
+  assert(last >= first);
+  assert(index != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (size > LONG_MAX) {
+    fputs("Input is too big\n", stderr);
+    return false;
+  }
+
+  Input in = {
+    .data = data,
+    .size = (long int)size,
+    .pos = 0,
+  };
+
+  return read_index(&in, first, last, index_offset, index, flags);
+}
+
+long int apoc_parse_vertices(ApocContext * const ctx,
+                             const void * const data, const size_t size,
+                             const long int file_pos,
+                             const int object_count,
+                             const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(data != NULL || size == 0);
+  assert(file_pos >= 0);
+  assert(object_count >= 0);
+  assert(!(flags & FLAGS_FLATS));
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (size > LONG_MAX) {
+    fputs("Input is too big\n", stderr);
+    return -1;
+  }
+
+  Input in = {
+    .data = data,
+    .size = (long int)size,
+    .pos = 0,
+  };
+
+  vertex_array_clear(&ctx->varray);
+  group_delete_all(&ctx->group);
+
+  int32_t nvertices;
+  if (!input_seek(&in, file_pos)) {
+    fprintf(stderr, "Bad file position %ld (object %d)\n", file_pos,
+            object_count);
+    return -1;
+  }
+
+  if (!read_num_vertices(&in, object_count, &nvertices)) {
+    return -1;
+  }
+
+  if (!parse_vertices(&in, object_count, &ctx->varray, nvertices, flags)) {
+    return -1;
+  }
+
+  return input_tell(&in);
+}
+
+long int apoc_parse_primitives(ApocContext * const ctx,
+                               const void * const data, const size_t size,
+                               const long int file_pos,
+                               const int object_count,
+                               const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(data != NULL || size == 0);
+  assert(file_pos >= 0);
+  assert(object_count >= 0);
+  assert(!(flags & FLAGS_FLATS));
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (size > LONG_MAX) {
+    fputs("Input is too big\n", stderr);
+    return -1;
+  }
+
+  Input in = {
+    .data = data,
+    .size = (long int)size,
+    .pos = 0,
+  };
+
+  int32_t nprimitives;
+  if (!input_seek(&in, file_pos)) {
+    fprintf(stderr, "Bad file position %ld (object %d)\n", file_pos,
+            object_count);
+    return -1;
+  }
+
+  if (!read_num_primitives(&in, object_count, &nprimitives)) {
+    return -1;
+  }
+
+  int remap_buffer[MaxNumVertices];
+  _Optional int *const remap =
+    (flags & (FLAGS_DUPLICATE | FLAGS_CLIP_POLYGONS)) ? NULL : remap_buffer;
+
+  if (!parse_primitives(&in, object_count, &ctx->varray, &ctx->group,
+                        nprimitives, remap, flags)) {
+    return -1;
+  }
+
+  return input_tell(&in);
+}
+
+/* Copies one object from the input into a model without converting its
+   coordinates. The object is read and checked in the same way as for
+   conversion. */
+static bool model_add_object(Input * const r, const int object_count,
+                             ApocModel * const model,
+                             ApocModelObject * const obj)
+{
+  assert(r != NULL);
+  assert(object_count >= 0);
+  assert(model != NULL);
+  assert(obj != NULL);
+
+  obj->file_pos = input_tell(r);
+  obj->first_vertex = (uint32_t)model->nvertices;
+  obj->first_primitive = (uint32_t)model->nprimitives;
+
+  int32_t nvertices, nprimitives = 0;
+  if (!read_num_vertices(r, object_count, &nvertices)) {
+    return false;
+  }
+
+  _Optional const unsigned char *const block =
+    read_vertex_block(r, nvertices, model->flats ? FLAGS_FLATS : 0);
+  if (block == NULL) {
+    return false;
+  }
+
+  int const bytes_per_vertex = model->flats ? BytesPerFlatVertex :
+                                              BytesPerVertex;
+  for (int v = 0; v < nvertices; ++v) {
+    const unsigned char *const vertex = &*block + (v * bytes_per_vertex);
+    if (!apoc_model_add_vertex(model, decode_int32(vertex),
+                               decode_int32(vertex + sizeof(int32_t)),
+                               model->flats ? 0 :
+                               decode_int32(vertex + 2 * sizeof(int32_t)))) {
+      return false;
+    }
+  }
+
+  if (!model->flats) {
+    const unsigned char *prims, *colours;
+    if (!read_num_primitives(r, object_count, &nprimitives) ||
+        !read_primitive_blocks(r, object_count, nprimitives, &prims,
+                               &colours) ||
+        !check_primitives(prims, nprimitives, nvertices, object_count)) {
+      return false;
+    }
+
+    for (int p = 0; p < nprimitives; ++p) {
+      const unsigned char *const prim = prims + (p * BytesPerPrimitive);
+      if (!apoc_model_add_primitive(model, prim[0], prim + 1, colours[p])) {
+        return false;
+      }
+    }
+  }
+
+  obj->size = input_tell(r) - obj->file_pos;
+  obj->nvertices = (uint32_t)nvertices;
+  obj->nprimitives = (uint32_t)nprimitives;
+  return true;
+}
+
+bool apoc_model_parse(ApocModel * const model,
+                      const void * const data, const size_t size,
+                      const long int index_offset, const int nobjects,
+                      const unsigned int flags)
+{
+  assert(model != NULL);
+  assert(data != NULL || size == 0);
+  assert(index_offset >= 0);
+  assert(nobjects >= 0);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (size > LONG_MAX) {
+    fputs("Input is too big\n", stderr);
+    return false;
+  }
+
+  Input in = {
+    .data = data,
+    .size = (long int)size,
+    .pos = 0,
+  };
+
+  int const count = get_index_size(&in, index_offset, nobjects, flags);
+  if (count < 0) {
+    return false;
+  }
+
+  _Optional long int *const index = alloc_index(count);
+  _Optional int *const aliases = malloc(sizeof(*aliases) *
+                                        (size_t)count);
+  _Optional ObjectPos *sorted = NULL;
   bool success = false;
-  long int index[MaxNumObjects > MaxNumFlats ? MaxNumObjects : MaxNumFlats];
 
-  if (read_index(in, first, last, index_offset, index, flags)) {
-    success = process_objects(in, out, first, last, name, index, flags);
+  if (aliases == NULL) {
+    fputs("Failed to allocate memory for aliases\n", stderr);
+  } else if (index != NULL &&
+             read_index(&in, 0, count - 1, index_offset, &*index,
+                        flags) &&
+             check_objects(&in, 0, count - 1, 0, count - 1, &*index,
+                           flags) &&
+             apoc_model_reset(model, (flags & FLAGS_FLATS) != 0, count)) {
+    sorted = sort_index(&*index, 0, count - 1);
+    success = sorted != NULL;
+  }
+
+  if (success) {
+    /* Each object is an alias of the first object at the same position,
+       which comes first in sorted order */
+    for (int i = 0; i < count; ++i) {
+      aliases[sorted[i].object_count] =
+        (i > 0 && sorted[i - 1].file_pos == sorted[i].file_pos) ?
+        aliases[sorted[i - 1].object_count] : sorted[i].object_count;
+    }
+  }
+
+  for (int object_count = 0; success && object_count < count;
+       ++object_count) {
+    /* Aliases of an earlier object share its data */
+    int const alias = aliases[object_count];
+    if (alias < object_count) {
+      model->objects[object_count] = model->objects[alias];
+    } else {
+      success = input_seek(&in, index[object_count]) &&
+                model_add_object(&in, object_count, model,
+                                 &model->objects[object_count]);
+    }
+  }
+
+  free(sorted);
+  free(aliases);
+  free(index);
+  return success;
+}
+
+bool apoc_model_get_object(const ApocModel * const model,
+                           const int object_count,
+                           VertexArray * const varray, Group * const group,
+                           int * const vobject, const unsigned int flags)
+{
+  assert(model != NULL);
+  assert(object_count >= 0);
+  assert(object_count < model->nobjects);
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(vobject != NULL);
+  assert(model->flats == ((flags & FLAGS_FLATS) != 0));
+  assert(!(flags & ~FLAGS_ALL));
+
+  const ApocModelObject *const obj = &model->objects[object_count];
+  int const nvertices = (int)obj->nvertices;
+  int const nprimitives = (int)obj->nprimitives;
+
+  vertex_array_clear(varray);
+  group_delete_all(group);
+
+  if (vertex_array_alloc_vertices(varray, nvertices) < nvertices) {
+    fprintf(stderr, "Failed to allocate memory for %d vertices "
+            "(object %d)\n", nvertices, object_count);
+    return false;
+  }
+
+  for (int v = 0; v < nvertices; ++v) {
+    size_t const mv = obj->first_vertex + (size_t)v;
+    Coord pos[3] = {model->x[mv], model->y[mv], model->z[mv]};
+    if (vertex_array_add_vertex(varray, &pos) < 0) {
+      fprintf(stderr, "Failed to allocate vertex memory "
+              "(vertex %d of object %d)\n", v, object_count);
+      return false;
+    }
+  }
+
+  const uint8_t *const nsides = &model->nsides[obj->first_primitive];
+  const uint8_t *const sides =
+    &model->sides[obj->first_primitive * (size_t)ApocModelMaxSides];
+
+  /* Duplicate vertices are merged as primitives are added, as when
+     parsing the input */
+  int remap_buffer[MaxNumVertices];
+  _Optional int *const remap =
+    (flags & (FLAGS_DUPLICATE | FLAGS_CLIP_POLYGONS)) ? NULL : remap_buffer;
+
+  if (remap != NULL) {
+    bool used[MaxNumVertices];
+    for (int v = 0; v < nvertices; ++v) {
+      used[v] = model->flats || (flags & FLAGS_UNUSED);
+    }
+    for (int p = 0; p < nprimitives; ++p) {
+      for (int s = 0; s < nsides[p]; ++s) {
+        used[sides[(p * ApocModelMaxSides) + s]] = true;
+      }
+    }
+    find_duplicates(varray, used, &*remap, object_count, flags);
+  }
+
+  /* A flat is one primitive whose sides are its vertices in order */
+  for (int p = 0; p < (model->flats ? 1 : nprimitives); ++p) {
+    _Optional Primitive * const pp = group_add_primitive(group);
+    if (pp == NULL) {
+      fprintf(stderr, "Failed to allocate primitive memory "
+              "(primitive %d of object %d)\n", p, object_count);
+      return false;
+    }
+    primitive_set_id(&*pp, group_get_num_primitives(group));
+
+    int const n = model->flats ? nvertices : nsides[p];
+    for (int s = 0; s < n; ++s) {
+      int const v = model->flats ? s : sides[(p * ApocModelMaxSides) + s];
+      if (primitive_add_side(&*pp, remap != NULL ? remap[v] : v) < 0) {
+        fprintf(stderr, "Failed to add side: too many sides? "
+                        "(side %d of primitive %d of object %d)\n",
+                s, p, object_count);
+        return false;
+      }
+    }
+
+    if (!model->flats) {
+      primitive_set_colour(&*pp,
+                           model->colours[obj->first_primitive + (size_t)p]);
+    }
+  }
+
+  if (model->flats && (flags & FLAGS_FLIP_BACKFACING)) {
+    flip_backfacing(varray, group, flags);
+  }
+
+  return prepare_object(varray, group, object_count, remap, vobject, NULL,
+                        NULL, flags);
+}
+
+bool apoc_list(const ApocObjectInfo * const objects, const int nobjects,
+               int first, int last, _Optional const char * const name,
+               const unsigned int flags)
+{
+  assert(objects != NULL);
+  assert(nobjects > 0);
+  assert(first >= -1);
+  assert(last == -1 || last >= first);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (!get_range(&first, &last, nobjects)) {
+    return false;
+  }
+
+  if (!select_objects(name, &first, &last, flags)) {
+    return true;
+  }
+
+  bool list_title = false;
+  for (int object_count = first; object_count <= last; ++object_count) {
+    char buffer[NameBufferSize];
+    const char *const object_name = (flags & FLAGS_FLATS) ?
+      get_flat_name(object_count, buffer, sizeof(buffer)) :
+      get_obj_name(object_count, buffer, sizeof(buffer));
+
+    list_object(object_name, object_count, &objects[object_count],
+                &list_title);
+  }
+  return true;
+}
+
+bool apoc_to_obj_mem(const void * const data, const size_t size,
+                     _Optional FILE * const out,
+                     int first, int last, _Optional const char * const name,
+                     const long int index_offset, const int nobjects,
+                     const char * const mtl_file,
+                     const int njobs, const unsigned int flags)
+{
+  ApocContext ctx;
+  apoc_context_init(&ctx);
+
+  bool const success = apoc_to_obj_ctx(&ctx, data, size, out, first, last,
+                                       name, index_offset, nobjects,
+                                       mtl_file, njobs, flags);
+  apoc_context_free(&ctx);
+  return success;
+}
+
+static long int read_from_reader(void * const buffer, size_t const size,
+                                 void * const arg)
+{
+  Reader *const reader = arg;
+  assert(buffer != NULL);
+  assert(reader != NULL);
+
+  if (reader_feof(reader)) {
+    return 0;
   }
+  size_t const n = reader_fread(buffer, 1, size, reader);
+  return (n == 0 && reader_ferror(reader)) ? -1 : (long int)n;
+}
+
+bool apoc_to_obj(Reader * const in, _Optional FILE * const out,
+                 int first, int last, _Optional const char * const name,
+                 const long int index_offset, const int nobjects,
+                 const char * const mtl_file, const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(!reader_ferror(in));
+
+  /* Objects are decoded from memory, so read the whole stream first */
+  _Optional unsigned char *buf = NULL;
+  size_t size = 0, buf_size = 0;
+
+  bool const success =
+    mapped_file_read_all(read_from_reader, in, &buf, &size, &buf_size) &&
+    apoc_to_obj_mem(&*buf, size, out, first, last, name, index_offset,
+                    nobjects, mtl_file, 1, flags);
 
+  free(buf);
   return success;
 }
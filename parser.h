@@ -9,18 +9,149 @@
 
 /* ISO C library headers */
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdint.h>
 
 /* StreamLib headers */
 #include "Reader.h"
 
+/* 3dObjLib headers */
+#include "Vertex.h"
+#include "Group.h"
+
+/* Local headers */
+#include "share.h"
+#include "glb.h"
+#include "ply.h"
+#include "archive.h"
+#include "model.h"
+#include "stats.h"
+#include "arena.h"
+#include "bytebuf.h"
+
 #if !defined(USE_OPTIONAL) && !defined(_Optional)
 #define _Optional
 #endif
 
+typedef struct Materials Materials;
+
+/* Holds all state for one conversion at a time. Separate contexts can be
+   used concurrently on different threads; reusing one context avoids
+   reallocating its buffers for every file. */
+typedef struct {
+  VertexArray varray;
+  Group group;
+  _Optional Materials *materials; /* names formatted for material_flags */
+  unsigned int material_flags;
+  int false_colour_count; /* no. of false colours assigned so far */
+  _Optional const char *fragment_dir; /* to reuse output, or NULL */
+  _Optional FILE *scratch; /* for output to be saved for reuse */
+  SharedVertices shared; /* vertices written for frames of shared_model */
+  int shared_model;
+  GlbWriter glb; /* objects to be written at the end */
+  PlyWriter ply;
+  ArchiveWriter archive;
+  _Optional ApocStats *stats; /* to gather statistics, or NULL */
+  Arena arena; /* for planes, vertex numbers and the -share vertex map */
+  ByteBuffer text; /* OBJ-format output for one object */
+  ByteBuffer fragment_text; /* the same, to be saved or reused */
+} ApocContext;
+
+void apoc_context_init(ApocContext *ctx);
+void apoc_context_free(ApocContext *ctx);
+
+/* As apoc_to_obj_mem, but uses the given context. */
+bool apoc_to_obj_ctx(ApocContext *ctx, const void *data, size_t size,
+                     _Optional FILE *out, const int first, const int last,
+                     _Optional const char *name,
+                     const long int index_offset, const int nobjects,
+                     const char *mtl_file,
+                     const int njobs, const unsigned int flags);
+
+/* Converts objects from an Apocalypse data file held in memory.
+   The index has nobjects entries, or if nobjects is 0 then its size is
+   found from the addresses in it. Objects are converted on up to njobs
+   threads but always written in index order. */
+bool apoc_to_obj_mem(const void *data, size_t size, _Optional FILE *out,
+                     const int first, const int last,
+                     _Optional const char *name,
+                     const long int index_offset, const int nobjects,
+                     const char *mtl_file,
+                     const int njobs, const unsigned int flags);
+
+/* What -list shows for an object. */
+typedef struct {
+  long int file_pos;   /* position of the object header */
+  long int size;       /* no. of bytes parsed */
+  int32_t nvertices;   /* from the object header */
+  int32_t nprimitives; /* from the object header (1 for a flat) */
+} ApocObjectInfo;
+
+/* Gets the file offset of the index of objects (or flats) in the game's
+   data. */
+long int apoc_default_index_offset(const unsigned int flags);
+
+/* Gets the no. of entries in an index, which is nobjects unless that is 0,
+   in which case addresses are read until one is bad or the index would
+   overlap the first object. Returns -1 on error. */
+int apoc_count_objects(const void *data, size_t size,
+                       const long int index_offset, const int nobjects,
+                       const unsigned int flags);
+
+/* Parses every object in an index of nobjects entries without converting
+   any, and fills in objects[0 .. nobjects-1]. */
+bool apoc_scan_ctx(ApocContext *ctx, const void *data, size_t size,
+                   const long int index_offset, const int nobjects,
+                   ApocObjectInfo *objects, const unsigned int flags);
+
+/* Lists objects in the same format as apoc_to_obj_mem, but from the
+   result of an earlier scan of nobjects objects. Returns false if the
+   first object isn't in the index. */
+bool apoc_list(const ApocObjectInfo *objects, const int nobjects,
+               const int first, const int last, _Optional const char *name,
+               const unsigned int flags);
+
+/* The first stages of conversion, which can be run separately to measure
+   their performance. apoc_read_index fills in index[first .. last] with
+   the file position of each object. apoc_parse_vertices parses the
+   vertices of the mesh at file_pos into ctx->varray, and
+   apoc_parse_primitives parses the primitives that follow them into
+   ctx->group (merging duplicate vertices unless flags say otherwise).
+   Both return the file position after the data parsed, or -1. */
+bool apoc_read_index(const void *data, size_t size,
+                     const long int index_offset, const int first,
+                     const int last, long int *index,
+                     const unsigned int flags);
+
+long int apoc_parse_vertices(ApocContext *ctx, const void *data,
+                             size_t size, const long int file_pos,
+                             const int object_count,
+                             const unsigned int flags);
+
+long int apoc_parse_primitives(ApocContext *ctx, const void *data,
+                               size_t size, const long int file_pos,
+                               const int object_count,
+                               const unsigned int flags);
+
+/* Parses every object in an index of nobjects entries (found as for
+   apoc_count_objects if 0) into a model, which holds them in a compact
+   form independent of any output format. */
+bool apoc_model_parse(ApocModel *model, const void *data, size_t size,
+                      const long int index_offset, const int nobjects,
+                      const unsigned int flags);
+
+/* Gets one object from a model and prepares its vertices and primitives
+   for output, as when converting directly from the input. vobject is set
+   to the no. of vertices to be output. */
+bool apoc_model_get_object(const ApocModel *model, const int object_count,
+                           VertexArray *varray, Group *group, int *vobject,
+                           const unsigned int flags);
+
+/* As apoc_to_obj_mem, but reads the whole input stream first. */
 bool apoc_to_obj(Reader *in, _Optional FILE *out, const int first,
                  const int last, _Optional const char *name,
-                 const long int index_offset, const char *mtl_file,
-                 const unsigned int flags);
+                 const long int index_offset, const int nobjects,
+                 const char *mtl_file, const unsigned int flags);
 
 #endif /* PARSER_H */
@@ -0,0 +1,227 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Coplanar polygon detection
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+
+/* Local header files */
+#include "planes.h"
+#include "misc.h"
+
+enum {
+  /* Small enough that plane equations can't overflow 64 bits */
+  MaxPlaneCoord = 1 << 18,
+};
+
+typedef struct {
+  int64_t plane[4]; /* reduced normal (first non-zero term positive) and
+                       distance from the origin */
+  int64_t min[2], max[2]; /* bounds projected onto the plane */
+} PrimitivePlane;
+
+static bool get_point(const VertexArray * const varray, int const v,
+                      int64_t (* const point)[3])
+{
+  assert(varray != NULL);
+  assert(point != NULL);
+
+  _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, v);
+  if (!coords) {
+    return false;
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(*point); ++i) {
+    Coord const c = (*coords)[i];
+    if (c < -MaxPlaneCoord || c > MaxPlaneCoord || c != (int64_t)c) {
+      return false;
+    }
+    (*point)[i] = (int64_t)c;
+  }
+  return true;
+}
+
+static int64_t gcd(int64_t a, int64_t b)
+{
+  if (a < 0) {
+    a = -a;
+  }
+  if (b < 0) {
+    b = -b;
+  }
+  while (b != 0) {
+    int64_t const t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* Gets the plane of a primitive and its bounds in that plane. Returns
+   false if the primitive is degenerate or not flat. */
+static bool get_plane(const VertexArray * const varray,
+                      const Primitive * const pp, PrimitivePlane * const pl)
+{
+  assert(varray != NULL);
+  assert(pp != NULL);
+  assert(pl != NULL);
+
+  int const nsides = primitive_get_num_sides(pp);
+  if (nsides < 3) {
+    return false;
+  }
+
+  int64_t p[3][3];
+  for (int s = 0; s < 3; ++s) {
+    if (!get_point(varray, primitive_get_side(pp, s), &p[s])) {
+      return false;
+    }
+  }
+
+  int64_t const a[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1],
+                        p[1][2] - p[0][2]};
+  int64_t const b[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1],
+                        p[2][2] - p[0][2]};
+  int64_t n[3] = {(a[1] * b[2]) - (a[2] * b[1]),
+                  (a[2] * b[0]) - (a[0] * b[2]),
+                  (a[0] * b[1]) - (a[1] * b[0])};
+
+  int64_t const div = gcd(gcd(n[0], n[1]), n[2]);
+  if (div == 0) {
+    return false;
+  }
+
+  /* Opposite-facing polygons share a bucket, to be safe */
+  int64_t const sign = (n[0] < 0 || (n[0] == 0 && n[1] < 0) ||
+                        (n[0] == 0 && n[1] == 0 && n[2] < 0)) ? -1 : 1;
+  for (size_t i = 0; i < ARRAY_SIZE(n); ++i) {
+    n[i] = n[i] / div * sign;
+    pl->plane[i] = n[i];
+  }
+  pl->plane[3] = (n[0] * p[0][0]) + (n[1] * p[0][1]) + (n[2] * p[0][2]);
+
+  /* Project onto the two axes other than the normal's biggest term */
+  int64_t const an[3] = {n[0] < 0 ? -n[0] : n[0], n[1] < 0 ? -n[1] : n[1],
+                         n[2] < 0 ? -n[2] : n[2]};
+  int const drop = (an[0] >= an[1] && an[0] >= an[2]) ? 0 :
+                   (an[1] >= an[2]) ? 1 : 2;
+  int const axes[2] = {drop == 0 ? 1 : 0, drop == 2 ? 1 : 2};
+
+  for (int s = 0; s < nsides; ++s) {
+    int64_t q[3];
+    if (!get_point(varray, primitive_get_side(pp, s), &q) ||
+        (n[0] * q[0]) + (n[1] * q[1]) + (n[2] * q[2]) != pl->plane[3]) {
+      return false;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+      int64_t const c = q[axes[i]];
+      if (s == 0 || c < pl->min[i]) {
+        pl->min[i] = c;
+      }
+      if (s == 0 || c > pl->max[i]) {
+        pl->max[i] = c;
+      }
+    }
+  }
+
+  return true;
+}
+
+static int compare_planes(const void * const a, const void * const b)
+{
+  const PrimitivePlane *const pa = a, *const pb = b;
+  for (size_t i = 0; i < ARRAY_SIZE(pa->plane); ++i) {
+    if (pa->plane[i] != pb->plane[i]) {
+      return pa->plane[i] < pb->plane[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+static bool bounds_overlap(const PrimitivePlane * const a,
+                           const PrimitivePlane * const b)
+{
+  assert(a != NULL);
+  assert(b != NULL);
+
+  /* Polygons which only touch along an edge don't overlap */
+  return a->min[0] < b->max[0] && b->min[0] < a->max[0] &&
+         a->min[1] < b->max[1] && b->min[1] < a->max[1];
+}
+
+bool planes_can_skip_clipping(const VertexArray * const varray,
+                              const Group * const group,
+                              _Optional Arena * const arena)
+{
+  assert(varray != NULL);
+  assert(group != NULL);
+
+  int const nprimitives = group_get_num_primitives(group);
+  if (nprimitives < 2) {
+    return true;
+  }
+
+  size_t const size = sizeof(PrimitivePlane) * (size_t)nprimitives;
+  _Optional PrimitivePlane *const planes = arena != NULL ?
+                                           arena_alloc(&*arena, size) :
+                                           malloc(size);
+  if (planes == NULL) {
+    return false;
+  }
+
+  bool overlap = false;
+  for (int p = 0; !overlap && p < nprimitives; ++p) {
+    _Optional const Primitive *const pp = group_get_primitive(group, p);
+    overlap = !pp || !get_plane(varray, &*pp, &planes[p]);
+  }
+
+  if (!overlap) {
+    qsort(&*planes, (size_t)nprimitives, sizeof(*planes), compare_planes);
+
+    /* Only primitives in the same bucket need to be compared */
+    for (int start = 0; !overlap && start < nprimitives; ) {
+      int end = start + 1;
+      while (end < nprimitives &&
+             !compare_planes(&planes[start], &planes[end])) {
+        ++end;
+      }
+
+      for (int i = start; !overlap && i < end; ++i) {
+        for (int j = i + 1; !overlap && j < end; ++j) {
+          overlap = bounds_overlap(&planes[i], &planes[j]);
+        }
+      }
+      start = end;
+    }
+  }
+
+  if (arena == NULL) {
+    free(planes);
+  }
+  return !overlap;
+}
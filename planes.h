@@ -0,0 +1,29 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Coplanar polygon detection
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef PLANES_H
+#define PLANES_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+
+/* 3dObjLib headers */
+#include "Vertex.h"
+#include "Group.h"
+
+/* Local headers */
+#include "arena.h"
+
+/* A fast path for clipping: buckets the primitives of a group by their
+   exact plane equations and returns true if no two primitives in the same
+   plane have overlapping bounds, in which case clipping of overlapping
+   coplanar polygons would have nothing to do. Otherwise (or if it can't be
+   determined) the whole group must still be clipped, at unchanged cost.
+   Working storage is allocated from arena, if not null. */
+bool planes_can_skip_clipping(const VertexArray *varray, const Group *group,
+                              _Optional Arena *arena);
+
+#endif /* PLANES_H */
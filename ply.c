@@ -0,0 +1,248 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Binary PLY output
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local header files */
+#include "ply.h"
+#include "bytebuf.h"
+#include "meshout.h"
+#include "flags.h"
+#include "version.h"
+#include "misc.h"
+
+enum {
+  MaxFaceSides = UCHAR_MAX, /* the vertex count is a uchar */
+  MaxColour = UCHAR_MAX,
+};
+
+void ply_init(PlyWriter * const ply)
+{
+  assert(ply != NULL);
+  byte_buffer_init(&ply->vertices);
+  byte_buffer_init(&ply->faces);
+  vertex_map_init(&ply->vmap);
+  ply_reset(ply);
+}
+
+void ply_free(PlyWriter * const ply)
+{
+  assert(ply != NULL);
+  byte_buffer_free(&ply->vertices);
+  byte_buffer_free(&ply->faces);
+  vertex_map_free(&ply->vmap);
+  ply_init(ply);
+}
+
+void ply_reset(PlyWriter * const ply)
+{
+  assert(ply != NULL);
+  byte_buffer_reset(&ply->vertices);
+  byte_buffer_reset(&ply->faces);
+  ply->nvertices = 0;
+  ply->nfaces = 0;
+}
+
+/* Outputs a vertex unless it (or a duplicate) has been output already. */
+static bool add_vertex(PlyWriter * const ply,
+                       const VertexArray * const varray, int const v)
+{
+  assert(ply != NULL);
+  assert(varray != NULL);
+
+  bool added;
+  if (vertex_map_add(&ply->vmap, varray, v, &added) < 0) {
+    return false;
+  }
+  if (!added) {
+    return true;
+  }
+
+  if (ply->nvertices >= INT32_MAX) {
+    fputs("Too many vertices for PLY output\n", stderr);
+    return false;
+  }
+
+  _Optional Coord (*const coords)[3] = vertex_array_get_coords(varray, v);
+  assert(coords != NULL);
+
+  for (size_t i = 0; i < ARRAY_SIZE(*coords); ++i) {
+    if (!byte_buffer_append_float(&ply->vertices, (float)(*coords)[i])) {
+      return false;
+    }
+  }
+  ++ply->nvertices;
+  return true;
+}
+
+/* Outputs a face with the given sides of a primitive. */
+static bool add_face(PlyWriter * const ply, const Primitive * const pp,
+                     long int const base, int const nsides,
+                     const int * const sides, int const colour,
+                     int const object_count)
+{
+  assert(ply != NULL);
+  assert(pp != NULL);
+  assert(base >= 0);
+  assert(nsides >= 3);
+  assert(nsides <= MaxFaceSides);
+  assert(sides != NULL);
+  assert(colour >= 0);
+  assert(colour <= MaxColour);
+  assert(object_count >= 0);
+
+  unsigned char const count = (unsigned char)nsides;
+  if (!byte_buffer_append(&ply->faces, &count, sizeof(count))) {
+    return false;
+  }
+
+  for (int s = 0; s < nsides; ++s) {
+    int const v = primitive_get_side(pp, sides[s]);
+    long int const index = base + vertex_map_get(&ply->vmap, v);
+    if (!byte_buffer_append_le32(&ply->faces, (uint32_t)index)) {
+      return false;
+    }
+  }
+
+  unsigned char const c = (unsigned char)colour;
+  if (!byte_buffer_append(&ply->faces, &c, sizeof(c)) ||
+      !byte_buffer_append_le32(&ply->faces, (uint32_t)object_count)) {
+    return false;
+  }
+  ++ply->nfaces;
+  return true;
+}
+
+bool ply_add_object(PlyWriter * const ply, int const object_count,
+                    const VertexArray * const varray,
+                    const Group * const group,
+                    _Optional OutputPrimitivesGetColourFn * const get_colour,
+                    void * const arg, const unsigned int flags)
+{
+  assert(ply != NULL);
+  assert(object_count >= 0);
+  assert(varray != NULL);
+  assert(group != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (!vertex_map_start(&ply->vmap, varray, flags)) {
+    return false;
+  }
+
+  /* Vertex indices are numbered from the first vertex of the file */
+  long int const base = ply->nvertices;
+
+  if (flags & FLAGS_UNUSED) {
+    int const nvertices = vertex_array_get_num_vertices(varray);
+    for (int v = 0; v < nvertices; ++v) {
+      if (!add_vertex(ply, varray, v)) {
+        return false;
+      }
+    }
+  }
+
+  int const nprimitives = group_get_num_primitives(group);
+  for (int p = 0; p < nprimitives; ++p) {
+    _Optional const Primitive *const pp = group_get_primitive(group, p);
+    if (pp == NULL) {
+      continue;
+    }
+
+    int const nsides = primitive_get_num_sides(&*pp);
+    if (nsides < 3) {
+      continue;
+    }
+
+    int const colour = get_colour ? get_colour(&*pp, arg) :
+                                    primitive_get_colour(&*pp);
+
+    for (int s = 0; s < nsides; ++s) {
+      if (!add_vertex(ply, varray, primitive_get_side(&*pp, s))) {
+        return false;
+      }
+    }
+
+    /* A face can't have more sides than its uchar vertex count allows, so
+       bigger polygons (e.g. flats) are split into triangles regardless */
+    if ((flags & (FLAGS_TRIANGLE_FANS | FLAGS_TRIANGLE_STRIPS)) ||
+        nsides > MaxFaceSides) {
+      for (int t = 0; t < nsides - 2; ++t) {
+        int sides[3];
+        get_triangle(nsides, t, flags, &sides);
+        if (!add_face(ply, &*pp, base, (int)ARRAY_SIZE(sides), sides,
+                      colour, object_count)) {
+          return false;
+        }
+      }
+    } else {
+      int sides[MaxFaceSides];
+      for (int s = 0; s < nsides; ++s) {
+        sides[s] = s;
+      }
+      if (!add_face(ply, &*pp, base, nsides, sides, colour, object_count)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool ply_write(const PlyWriter * const ply, FILE * const out)
+{
+  assert(ply != NULL);
+  assert(out != NULL);
+
+  if (fprintf(out, "ply\n"
+                   "format binary_little_endian 1.0\n"
+                   "comment Apocalypse graphics\n"
+                   "comment Converted by ApoctoObj "VERSION_STRING"\n"
+                   "element vertex %ld\n"
+                   "property float x\n"
+                   "property float y\n"
+                   "property float z\n"
+                   "element face %ld\n"
+                   "property list uchar int vertex_indices\n"
+                   "property uchar colour\n"
+                   "property uint object\n"
+                   "end_header\n", ply->nvertices, ply->nfaces) < 0 ||
+      (ply->vertices.len > 0 &&
+       fwrite(&*ply->vertices.data, ply->vertices.len, 1, out) != 1) ||
+      (ply->faces.len > 0 &&
+       fwrite(&*ply->faces.data, ply->faces.len, 1, out) != 1)) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,54 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Binary PLY output
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef PLY_H
+#define PLY_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stdio.h>
+
+/* 3dObjLib headers */
+#include "Vertex.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local headers */
+#include "bytebuf.h"
+#include "meshout.h"
+
+/* Accumulates objects for a binary PLY file, which can't be written until
+   all of them are known because its header includes the no. of vertices
+   and faces. Every face has the colour number of its primitive and the
+   number of its object. */
+typedef struct {
+  ByteBuffer vertices; /* x, y and z coordinates */
+  ByteBuffer faces;    /* vertex indices, colour and object number */
+  long int nvertices, nfaces;
+  VertexMap vmap;      /* workspace for the object being added */
+} PlyWriter;
+
+void ply_init(PlyWriter *ply);
+void ply_free(PlyWriter *ply);
+
+/* Empties the vertex and face lists, e.g. before converting another
+   file. */
+void ply_reset(PlyWriter *ply);
+
+/* Appends the vertices and faces of an object, tagging each face with
+   object_count and the colour of its primitive (or the colour returned by
+   get_colour, if not null). Polygons with more sides than a PLY face can
+   have are split into triangles, as are all polygons if flags say so. */
+bool ply_add_object(PlyWriter *ply, int object_count,
+                    const VertexArray *varray, const Group *group,
+                    _Optional OutputPrimitivesGetColourFn *get_colour,
+                    void *arg, unsigned int flags);
+
+/* Writes a header with the final no. of vertices and faces, followed by
+   the binary data for every object added since the last reset. */
+bool ply_write(const PlyWriter *ply, FILE *out);
+
+#endif /* PLY_H */
@@ -0,0 +1,167 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Vertices shared between animation frames
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Local header files */
+#include "share.h"
+#include "cache.h"
+#include "misc.h"
+
+enum {
+  MinEntries = 256,
+  MinPoolSize = 4096,
+};
+
+void shared_vertices_init(SharedVertices * const sv)
+{
+  assert(sv != NULL);
+  sv->entries = NULL;
+  sv->nentries = 0;
+  sv->count = 0;
+  sv->pool = NULL;
+  sv->pool_size = 0;
+  sv->pool_len = 0;
+}
+
+void shared_vertices_free(SharedVertices * const sv)
+{
+  assert(sv != NULL);
+  free(sv->entries);
+  free(sv->pool);
+  shared_vertices_init(sv);
+}
+
+void shared_vertices_reset(SharedVertices * const sv)
+{
+  assert(sv != NULL);
+  if (sv->count > 0) {
+    memset(&*sv->entries, 0, sizeof(*sv->entries) * sv->nentries);
+  }
+  sv->count = 0;
+  sv->pool_len = 0;
+}
+
+/* Finds the entry for the given text, or the unused entry where it
+   belongs. The table must not be full. */
+static SharedVertex *find_entry(const SharedVertices * const sv,
+                                const uint64_t hash,
+                                const char * const text, size_t const len)
+{
+  assert(sv != NULL);
+  assert(sv->entries != NULL);
+  assert(sv->count < sv->nentries);
+  assert(text != NULL);
+
+  size_t const mask = sv->nentries - 1;
+  for (size_t i = (size_t)hash & mask; ; i = (i + 1) & mask) {
+    SharedVertex *const e = &sv->entries[i];
+    if (e->index == 0 ||
+        (e->hash == hash && e->len == len &&
+         !memcmp(&*sv->pool + e->offset, text, len))) {
+      return e;
+    }
+  }
+}
+
+int shared_vertices_find(const SharedVertices * const sv,
+                         const char * const text, size_t const len)
+{
+  assert(sv != NULL);
+  assert(text != NULL);
+
+  if (sv->count == 0) {
+    return 0;
+  }
+  return find_entry(sv, cache_hash(text, len), text, len)->index;
+}
+
+static bool grow_entries(SharedVertices * const sv)
+{
+  assert(sv != NULL);
+
+  size_t const nentries = sv->nentries ? sv->nentries * 2 : MinEntries;
+  _Optional SharedVertex *const entries = calloc(nentries, sizeof(*entries));
+  if (entries == NULL) {
+    return false;
+  }
+
+  _Optional SharedVertex *const old = sv->entries;
+  size_t const old_n = sv->nentries;
+  sv->entries = entries;
+  sv->nentries = nentries;
+
+  for (size_t i = 0; i < old_n; ++i) {
+    if (old[i].index != 0) {
+      size_t const mask = nentries - 1;
+      size_t j = (size_t)old[i].hash & mask;
+      while (entries[j].index != 0) {
+        j = (j + 1) & mask;
+      }
+      entries[j] = old[i];
+    }
+  }
+
+  free(old);
+  return true;
+}
+
+bool shared_vertices_add(SharedVertices * const sv, const char * const text,
+                         size_t const len, int const index)
+{
+  assert(sv != NULL);
+  assert(text != NULL);
+  assert(index > 0);
+
+  /* Keep the table no more than half full */
+  if ((sv->count + 1) * 2 > sv->nentries && !grow_entries(sv)) {
+    return false;
+  }
+
+  if (sv->pool_size - sv->pool_len < len) {
+    size_t new_size = sv->pool_size ? sv->pool_size : MinPoolSize;
+    while (new_size - sv->pool_len < len) {
+      new_size *= 2;
+    }
+    _Optional char *const pool = realloc(sv->pool, new_size);
+    if (pool == NULL) {
+      return false;
+    }
+    sv->pool = pool;
+    sv->pool_size = new_size;
+  }
+
+  uint64_t const hash = cache_hash(text, len);
+  SharedVertex *const e = find_entry(sv, hash, text, len);
+  if (e->index == 0) {
+    memcpy(&*sv->pool + sv->pool_len, text, len);
+    e->hash = hash;
+    e->offset = sv->pool_len;
+    e->len = len;
+    sv->pool_len += len;
+    ++sv->count;
+  }
+  e->index = index;
+  return true;
+}
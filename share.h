@@ -0,0 +1,49 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Vertices shared between animation frames
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef SHARE_H
+#define SHARE_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef struct {
+  uint64_t hash;
+  size_t offset; /* of the vertex text in the pool */
+  size_t len;
+  int index;     /* 0 if the entry is unused */
+} SharedVertex;
+
+/* Maps the text of vertices already written to their indices. */
+typedef struct {
+  _Optional SharedVertex *entries;
+  size_t nentries; /* a power of two, or 0 */
+  size_t count;    /* no. of entries used */
+  _Optional char *pool;
+  size_t pool_size, pool_len;
+} SharedVertices;
+
+void shared_vertices_init(SharedVertices *sv);
+void shared_vertices_free(SharedVertices *sv);
+
+/* Forgets all vertices, e.g. at the start of a different model. */
+void shared_vertices_reset(SharedVertices *sv);
+
+/* Returns the index of a vertex with the given text, or 0 if none. */
+int shared_vertices_find(const SharedVertices *sv, const char *text,
+                         size_t len);
+
+/* Records the index of a vertex with the given text. */
+bool shared_vertices_add(SharedVertices *sv, const char *text, size_t len,
+                         int index);
+
+#endif /* SHARE_H */
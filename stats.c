@@ -0,0 +1,161 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Per-stage timing and counters
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+/* Local header files */
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
+#include "misc.h"
+
+static const char *const stage_names[] = {
+  [ApocStage_ReadIndex] = "read_index",
+  [ApocStage_ParseVertices] = "parse_vertices",
+  [ApocStage_ParsePrimitives] = "parse_primitives",
+  [ApocStage_Clip] = "clip_polygons",
+  [ApocStage_MarkVertices] = "mark_vertices",
+  [ApocStage_FindDuplicates] = "find_duplicates",
+  [ApocStage_Renumber] = "renumber",
+  [ApocStage_Output] = "output",
+};
+
+void apoc_stats_init(ApocStats * const stats)
+{
+  assert(stats != NULL);
+  *stats = (ApocStats){.trace = NULL};
+}
+
+void apoc_stats_add(ApocStats * const dst, const ApocStats * const src)
+{
+  assert(dst != NULL);
+  assert(src != NULL);
+
+  for (int s = 0; s < ApocStage_Count; ++s) {
+    dst->seconds[s] += src->seconds[s];
+  }
+  dst->total += src->total;
+  dst->nfiles += src->nfiles;
+  dst->bytes_read += src->bytes_read;
+  dst->seeks += src->seeks;
+  dst->objects += src->objects;
+  dst->vertices_culled += src->vertices_culled;
+  dst->primitives_emitted += src->primitives_emitted;
+}
+
+double apoc_stats_start(_Optional const ApocStats * const stats)
+{
+  return stats != NULL ? timer_now() : 0.0;
+}
+
+void apoc_stats_stop(_Optional ApocStats * const stats,
+                     ApocStage const stage, double const start)
+{
+  assert(stage >= 0);
+  assert(stage < ApocStage_Count);
+
+  if (stats != NULL) {
+    double const end = timer_now();
+    stats->seconds[stage] += end - start;
+    if (stats->trace != NULL) {
+      apoc_trace_span(&*stats->trace, "stage", stage_names[stage], -1,
+                      start, end);
+    }
+  }
+}
+
+void apoc_stats_span(_Optional ApocStats * const stats,
+                     const char * const category, const char * const name,
+                     int const object, double const start)
+{
+  assert(category != NULL);
+  assert(name != NULL);
+
+  if (stats != NULL && stats->trace != NULL) {
+    apoc_trace_span(&*stats->trace, category, name, object, start,
+                    timer_now());
+  }
+}
+
+const char *apoc_stage_name(ApocStage const stage)
+{
+  assert(stage >= 0);
+  assert(stage < ApocStage_Count);
+  return stage_names[stage];
+}
+
+void apoc_stats_print(const ApocStats * const stats, FILE * const out)
+{
+  assert(stats != NULL);
+  assert(out != NULL);
+
+  fprintf(out, "Statistics for %ld file%s:\n", stats->nfiles,
+          stats->nfiles == 1 ? "" : "s");
+
+  for (int s = 0; s < ApocStage_Count; ++s) {
+    fprintf(out, "  %-20s %12.6f s\n", apoc_stage_name((ApocStage)s),
+            stats->seconds[s]);
+  }
+
+  fprintf(out, "  %-20s %12.6f s\n"
+               "  %-20s %12" PRIu64 "\n"
+               "  %-20s %12" PRIu64 "\n"
+               "  %-20s %12" PRIu64 "\n"
+               "  %-20s %12" PRIu64 "\n"
+               "  %-20s %12" PRIu64 "\n",
+          "total", stats->total,
+          "bytes_read", stats->bytes_read,
+          "seeks", stats->seeks,
+          "objects", stats->objects,
+          "vertices_culled", stats->vertices_culled,
+          "primitives_emitted", stats->primitives_emitted);
+}
+
+bool apoc_stats_write_json(const ApocStats * const stats, FILE * const out)
+{
+  assert(stats != NULL);
+  assert(out != NULL);
+
+  if (fprintf(out, "{\n  \"files\": %ld,\n  \"total\": %.9f,\n"
+                   "  \"stages\": {", stats->nfiles, stats->total) < 0) {
+    return false;
+  }
+
+  for (int s = 0; s < ApocStage_Count; ++s) {
+    if (fprintf(out, "%s\n    \"%s\": %.9f", s > 0 ? "," : "",
+                apoc_stage_name((ApocStage)s), stats->seconds[s]) < 0) {
+      return false;
+    }
+  }
+
+  return fprintf(out, "\n  },\n  \"counters\": {\n"
+                      "    \"bytes_read\": %" PRIu64 ",\n"
+                      "    \"seeks\": %" PRIu64 ",\n"
+                      "    \"objects\": %" PRIu64 ",\n"
+                      "    \"vertices_culled\": %" PRIu64 ",\n"
+                      "    \"primitives_emitted\": %" PRIu64 "\n"
+                      "  }\n}\n",
+                 stats->bytes_read, stats->seeks, stats->objects,
+                 stats->vertices_culled, stats->primitives_emitted) >= 0;
+}
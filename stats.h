@@ -0,0 +1,74 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Per-stage timing and counters
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* Local headers */
+#include "trace.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef enum {
+  ApocStage_ReadIndex,
+  ApocStage_ParseVertices,   /* including flats */
+  ApocStage_ParsePrimitives,
+  ApocStage_Clip,
+  ApocStage_MarkVertices,
+  ApocStage_FindDuplicates,
+  ApocStage_Renumber,
+  ApocStage_Output,
+  ApocStage_Count
+} ApocStage;
+
+/* Statistics for one or more conversions. Stage times are summed over
+   all threads, so they can exceed the total time. */
+typedef struct {
+  double seconds[ApocStage_Count];
+  double total;       /* elapsed time for each file, summed */
+  long int nfiles;
+  uint64_t bytes_read;
+  uint64_t seeks;
+  uint64_t objects;   /* no. of objects parsed */
+  uint64_t vertices_culled;    /* unused, duplicate or clipped away */
+  uint64_t primitives_emitted;
+  _Optional ApocTrace *trace; /* to record each stage as a span, or NULL */
+} ApocStats;
+
+void apoc_stats_init(ApocStats *stats);
+
+/* Adds the statistics from src to dst, e.g. to aggregate a batch.
+   Doesn't change dst's trace. */
+void apoc_stats_add(ApocStats *dst, const ApocStats *src);
+
+/* Gets the start time of a stage, or 0 if statistics aren't wanted. */
+double apoc_stats_start(_Optional const ApocStats *stats);
+
+/* Adds the time since start to a stage, if statistics are wanted. */
+void apoc_stats_stop(_Optional ApocStats *stats, ApocStage stage,
+                     double start);
+
+/* Records a span from start until now, if a trace is wanted, e.g. for
+   the conversion of a whole file or object. */
+void apoc_stats_span(_Optional ApocStats *stats, const char *category,
+                     const char *name, int object, double start);
+
+const char *apoc_stage_name(ApocStage stage);
+
+/* Writes a table of statistics for people to read. */
+void apoc_stats_print(const ApocStats *stats, FILE *out);
+
+/* Writes statistics as a JSON object. */
+bool apoc_stats_write_json(const ApocStats *stats, FILE *out);
+
+#endif /* STATS_H */
@@ -0,0 +1,55 @@
+# Converts the same input twice with different switches and checks that
+# the outputs match, byte for byte unless a CHECK program is given, which
+# is run with its switches followed by the two output files. Switches are
+# separated by spaces.
+#
+# cmake -DAPOC=<converter> -DINPUT=<file> -DNAME=<output prefix>
+#       [-DFIRST=<switches>] [-DSECOND=<switches>]
+#       [-DCHECK=<program>] [-DCHECK_ARGS=<switches>]
+#       [-DCLEAN=<directory emptied before the first conversion>]
+#       -P compare.cmake
+
+foreach(var APOC INPUT NAME)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "${var} must be defined")
+    endif()
+endforeach()
+
+if(DEFINED CLEAN)
+    file(REMOVE_RECURSE "${CLEAN}")
+    file(MAKE_DIRECTORY "${CLEAN}")
+endif()
+
+set(outputs)
+foreach(run FIRST SECOND)
+    set(output "${NAME}_${run}.out")
+    separate_arguments(switches UNIX_COMMAND "${${run}}")
+    file(REMOVE "${output}")
+    execute_process(COMMAND "${APOC}" ${switches} "${INPUT}" "${output}"
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Conversion with '${${run}}' failed: ${result}")
+    endif()
+    list(APPEND outputs "${output}")
+
+    if(DEFINED CLEAN AND run STREQUAL FIRST)
+        # Otherwise, the second conversion would be no different
+        file(GLOB cached "${CLEAN}/*")
+        if(NOT cached)
+            message(FATAL_ERROR "Nothing was written to ${CLEAN}")
+        endif()
+    endif()
+endforeach()
+
+if(DEFINED CHECK)
+    separate_arguments(check_args UNIX_COMMAND "${CHECK_ARGS}")
+    execute_process(COMMAND "${CHECK}" ${check_args} ${outputs}
+                    RESULT_VARIABLE result)
+else()
+    execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files ${outputs}
+                    RESULT_VARIABLE result)
+endif()
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Output with '${FIRST}' doesn't match '${SECOND}'")
+endif()
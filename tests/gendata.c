@@ -0,0 +1,73 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Writes a synthetic input file for the tests
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* Local header files */
+#include "apocgen.h"
+#include "bytebuf.h"
+#include "misc.h"
+
+/* Generates a file with the default parameters, whose objects include
+   frames of every animated model, and writes it to the named file. */
+int main(int argc, const char *argv[])
+{
+  assert(argc > 0);
+  assert(argv != NULL);
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <output-file>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  ApocGenParams params;
+  apoc_gen_params_init(&params);
+
+  ByteBuffer data;
+  byte_buffer_init(&data);
+  long int index_offset;
+  bool success = apoc_generate(&params, &data, &index_offset);
+
+  if (success) {
+    _Optional FILE *const f = fopen(argv[1], "wb");
+    if (f == NULL) {
+      fprintf(stderr, "Failed to open output file '%s': %s\n",
+              argv[1], strerror(errno));
+      success = false;
+    } else {
+      success = fwrite(&*data.data, data.len, 1, &*f) == 1;
+      if (fclose(&*f)) {
+        success = false;
+      }
+      if (!success) {
+        fprintf(stderr, "Failed to write output file '%s': %s\n",
+                argv[1], strerror(errno));
+      }
+    }
+  }
+
+  byte_buffer_free(&data);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,511 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Checks the output of the converter for the tests
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "bytebuf.h"
+#include "decode.h"
+#include "misc.h"
+
+enum {
+  LineBufferSize = 1024,
+  GlbMagic = 0x46546c67,      /* "glTF" */
+  GlbVersion = 2,
+  ChunkTypeJSON = 0x4e4f534a, /* "JSON" */
+  ChunkTypeBIN = 0x004e4942,  /* "BIN\0" */
+  GlbHeaderSize = 12,
+  ChunkHeaderSize = 8,
+};
+
+/* An OBJ file with the vertices of each face replaced by their
+   coordinates, so that files which number their vertices differently
+   can be compared. */
+typedef struct {
+  ByteBuffer coords; /* x, y and z of every vertex, as doubles */
+  ByteBuffer text;   /* object, material and face lines */
+  ByteBuffer faces;  /* no. of sides and vertex numbers of each face, as
+                        long ints */
+  long int nobjects, nvertices, nfaces, ntriangles;
+} ObjSummary;
+
+static void obj_summary_init(ObjSummary * const obj)
+{
+  assert(obj != NULL);
+  byte_buffer_init(&obj->coords);
+  byte_buffer_init(&obj->text);
+  byte_buffer_init(&obj->faces);
+  obj->nobjects = obj->nvertices = obj->nfaces = obj->ntriangles = 0;
+}
+
+static void obj_summary_free(ObjSummary * const obj)
+{
+  assert(obj != NULL);
+  byte_buffer_free(&obj->coords);
+  byte_buffer_free(&obj->text);
+  byte_buffer_free(&obj->faces);
+}
+
+/* Appends the coordinates of each vertex of a face, whose vertex numbers
+   are relative to the end of the vertex list if negative. */
+static bool add_face(ObjSummary * const obj, const char *s,
+                     const char * const file_name, long int const line)
+{
+  assert(obj != NULL);
+  assert(s != NULL);
+  assert(file_name != NULL);
+
+  /* The no. of sides is filled in afterwards */
+  size_t const start = obj->faces.len;
+  long int nsides = 0;
+  bool success = byte_buffer_append(&obj->text, "f", 1) &&
+                 byte_buffer_append(&obj->faces, &nsides, sizeof(nsides));
+
+  while (success) {
+    char *end;
+    long int const n = strtol(s, &end, 10);
+    if (end == s) {
+      break;
+    }
+    s = end;
+
+    long int const v = n < 0 ? obj->nvertices + n : n - 1;
+    if (n == 0 || v < 0 || v >= obj->nvertices) {
+      fprintf(stderr, "%s:%ld: Bad vertex number %ld\n", file_name, line, n);
+      return false;
+    }
+
+    double coords[3];
+    memcpy(coords, &*obj->coords.data + ((size_t)v * sizeof(coords)),
+           sizeof(coords));
+    success = byte_buffer_printf(&obj->text, " (%.17g %.17g %.17g)",
+                                 coords[0], coords[1], coords[2]) &&
+              byte_buffer_append(&obj->faces, &v, sizeof(v));
+    ++nsides;
+  }
+
+  if (success && nsides < 3) {
+    fprintf(stderr, "%s:%ld: Face has %ld sides\n", file_name, line,
+            nsides);
+    return false;
+  }
+
+  if (success) {
+    memcpy(&*obj->faces.data + start, &nsides, sizeof(nsides));
+  }
+
+  ++obj->nfaces;
+  obj->ntriangles += nsides - 2;
+  return success && byte_buffer_append(&obj->text, "\n", 1);
+}
+
+static bool read_obj(ObjSummary * const obj, const char * const file_name)
+{
+  assert(obj != NULL);
+  assert(file_name != NULL);
+
+  _Optional FILE *const f = fopen(file_name, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open input file '%s': %s\n",
+            file_name, strerror(errno));
+    return false;
+  }
+
+  bool success = true;
+  char buf[LineBufferSize];
+  for (long int line = 1; success && fgets(buf, sizeof(buf), &*f); ++line) {
+    if (strchr(buf, '\n') == NULL) {
+      fprintf(stderr, "%s:%ld: Line is too long\n", file_name, line);
+      success = false;
+    } else if (buf[0] == 'v' && buf[1] == ' ') {
+      double coords[3];
+      if (sscanf(buf + 2, "%lf %lf %lf", &coords[0], &coords[1],
+                 &coords[2]) != 3) {
+        fprintf(stderr, "%s:%ld: Bad vertex\n", file_name, line);
+        success = false;
+      } else {
+        success = byte_buffer_append(&obj->coords, coords, sizeof(coords));
+        ++obj->nvertices;
+      }
+    } else if (buf[0] == 'f' && buf[1] == ' ') {
+      success = add_face(obj, buf + 2, file_name, line);
+    } else if (!strncmp(buf, "o ", 2) || !strncmp(buf, "usemtl ", 7)) {
+      if (buf[0] == 'o') {
+        ++obj->nobjects;
+      }
+      success = byte_buffer_append(&obj->text, buf, strlen(buf));
+    }
+  }
+
+  if (success && ferror(&*f)) {
+    fprintf(stderr, "Failed reading from input file '%s': %s\n",
+            file_name, strerror(errno));
+    success = false;
+  }
+  fclose(&*f);
+  return success;
+}
+
+/* Checks that two OBJ files have the same objects, materials and faces,
+   and that each face has the same coordinates, however its vertices are
+   numbered. */
+static bool check_faces(const char * const file_a, const char * const file_b)
+{
+  assert(file_a != NULL);
+  assert(file_b != NULL);
+
+  ObjSummary a, b;
+  obj_summary_init(&a);
+  obj_summary_init(&b);
+
+  bool success = read_obj(&a, file_a) && read_obj(&b, file_b);
+  if (success && (a.text.len != b.text.len ||
+                  (a.text.len > 0 &&
+                   memcmp(&*a.text.data, &*b.text.data, a.text.len)))) {
+    size_t i = 0, line = 1;
+    while (i < a.text.len && i < b.text.len &&
+           a.text.data[i] == b.text.data[i]) {
+      if (a.text.data[i++] == '\n') {
+        ++line;
+      }
+    }
+    fprintf(stderr, "Object, material or face %zu of '%s' and '%s' "
+            "differs\n", line, file_a, file_b);
+    success = false;
+  }
+
+  obj_summary_free(&b);
+  obj_summary_free(&a);
+  return success;
+}
+
+static bool read_file(ByteBuffer * const buf, const char * const file_name)
+{
+  assert(buf != NULL);
+  assert(file_name != NULL);
+
+  _Optional FILE *const f = fopen(file_name, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open input file '%s': %s\n",
+            file_name, strerror(errno));
+    return false;
+  }
+
+  bool success = true;
+  size_t n;
+  do {
+    _Optional unsigned char *const dst = byte_buffer_extend(buf,
+                                                            LineBufferSize);
+    if (dst == NULL) {
+      success = false;
+      break;
+    }
+    n = fread(&*dst, 1, LineBufferSize, &*f);
+    buf->len -= LineBufferSize - n;
+  } while (n == LineBufferSize);
+
+  if (success && ferror(&*f)) {
+    fprintf(stderr, "Failed reading from input file '%s': %s\n",
+            file_name, strerror(errno));
+    success = false;
+  }
+  fclose(&*f);
+  return success;
+}
+
+/* Adds the values of a JSON member everywhere it occurs in text with the
+   given suffix, e.g. the counts of accessors of a given type. */
+static long int sum_members(const char * const text, const char * const name,
+                            const char * const suffix)
+{
+  assert(text != NULL);
+  assert(name != NULL);
+  assert(suffix != NULL);
+
+  long int sum = 0;
+  size_t const len = strlen(name);
+  for (const char *s = strstr(text, name); s != NULL; s = strstr(s, name)) {
+    char *end;
+    long int const value = strtol(s + len, &end, 10);
+    if (!strncmp(end, suffix, strlen(suffix))) {
+      sum += value;
+    }
+    s = end;
+  }
+  return sum;
+}
+
+/* Checks the header and chunks of a binary glTF file, and that it has as
+   many nodes, vertices and triangles as an OBJ file of the same objects. */
+static bool check_glb(const char * const glb_file,
+                      const char * const obj_file)
+{
+  assert(glb_file != NULL);
+  assert(obj_file != NULL);
+
+  ByteBuffer glb;
+  byte_buffer_init(&glb);
+  ObjSummary obj;
+  obj_summary_init(&obj);
+  _Optional char *json = NULL;
+
+  bool success = read_file(&glb, glb_file) && read_obj(&obj, obj_file);
+  const unsigned char *const d = &*glb.data;
+  size_t json_len = 0, bin_len = 0;
+
+  if (success) {
+    if (glb.len < GlbHeaderSize + ChunkHeaderSize ||
+        decode_int32(d) != GlbMagic ||
+        decode_int32(d + 4) != GlbVersion ||
+        (size_t)decode_int32(d + 8) != glb.len) {
+      fprintf(stderr, "Bad header in '%s'\n", glb_file);
+      success = false;
+    } else {
+      json_len = (size_t)decode_int32(d + GlbHeaderSize);
+      if (decode_int32(d + GlbHeaderSize + 4) != ChunkTypeJSON ||
+          json_len % 4 != 0 ||
+          json_len > glb.len - GlbHeaderSize - ChunkHeaderSize) {
+        fprintf(stderr, "Bad JSON chunk in '%s'\n", glb_file);
+        success = false;
+      }
+    }
+  }
+
+  if (success) {
+    size_t const bin = GlbHeaderSize + ChunkHeaderSize + json_len;
+    if (bin < glb.len) {
+      bin_len = glb.len - bin - ChunkHeaderSize;
+      if (glb.len - bin < ChunkHeaderSize ||
+          decode_int32(d + bin + 4) != ChunkTypeBIN ||
+          (size_t)decode_int32(d + bin) != bin_len) {
+        fprintf(stderr, "Bad binary chunk in '%s'\n", glb_file);
+        success = false;
+      }
+    }
+  }
+
+  if (success) {
+    json = malloc(json_len + 1);
+    if (json == NULL) {
+      fputs("Failed to allocate memory for JSON\n", stderr);
+      success = false;
+    } else {
+      memcpy(&*json, d + GlbHeaderSize + ChunkHeaderSize, json_len);
+      json[json_len] = '\0';
+    }
+  }
+
+  if (success) {
+    /* Every object has a node, even if it has no mesh */
+    static const char scene_nodes[] = "\"nodes\":[";
+    long int nnodes = 0;
+    const char *s = strstr(&*json, scene_nodes);
+    if (s != NULL) {
+      s += sizeof(scene_nodes) - 1;
+      nnodes = *s != ']';
+      for (; *s != ']' && *s != '\0'; ++s) {
+        if (*s == ',') {
+          ++nnodes;
+        }
+      }
+    }
+
+    static const char buffers[] = "\"buffers\":[{\"byteLength\":";
+    s = strstr(&*json, buffers);
+    long int const byte_length = s != NULL ?
+      strtol(s + sizeof(buffers) - 1, NULL, 10) : 0;
+    long int const npositions = sum_members(&*json, "\"count\":",
+                                            ",\"type\":\"VEC3\"");
+    long int const nindices = sum_members(&*json, "\"count\":",
+                                          ",\"type\":\"SCALAR\"");
+
+    if (nnodes != obj.nobjects) {
+      fprintf(stderr, "'%s' has %ld nodes but '%s' has %ld objects\n",
+              glb_file, nnodes, obj_file, obj.nobjects);
+      success = false;
+    }
+    if ((size_t)byte_length > bin_len || bin_len - (size_t)byte_length >= 4) {
+      fprintf(stderr, "'%s' has a buffer of %ld bytes in a chunk of %zu\n",
+              glb_file, byte_length, bin_len);
+      success = false;
+    }
+    if (npositions != obj.nvertices) {
+      fprintf(stderr, "'%s' has %ld positions but '%s' has %ld vertices\n",
+              glb_file, npositions, obj_file, obj.nvertices);
+      success = false;
+    }
+    if (nindices != obj.ntriangles * 3) {
+      fprintf(stderr, "'%s' has %ld indices but '%s' has %ld triangles\n",
+              glb_file, nindices, obj_file, obj.ntriangles);
+      success = false;
+    }
+  }
+
+  free(json);
+  obj_summary_free(&obj);
+  byte_buffer_free(&glb);
+  return success;
+}
+
+/* Gets a little-endian float from a PLY file. */
+static float decode_float(const unsigned char * const src)
+{
+  assert(src != NULL);
+  uint32_t const bits = (uint32_t)decode_int32(src);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/* Checks the header of a binary PLY file, that its size matches the no. of
+   vertices and faces in the header, and that it has the same faces as an
+   OBJ file of the same objects, with coordinates rounded to floats. */
+static bool check_ply(const char * const ply_file,
+                      const char * const obj_file)
+{
+  assert(ply_file != NULL);
+  assert(obj_file != NULL);
+
+  static const char format[] =
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "comment %*[^\n]\n"
+    "comment %*[^\n]\n"
+    "element vertex %ld\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "element face %ld\n"
+    "property list uchar int vertex_indices\n"
+    "property uchar colour\n"
+    "property uint object\n"
+    "end_header\n%n";
+
+  ByteBuffer ply;
+  byte_buffer_init(&ply);
+  ObjSummary obj;
+  obj_summary_init(&obj);
+
+  bool success = read_file(&ply, ply_file) && read_obj(&obj, obj_file) &&
+                 byte_buffer_append(&ply, "", 1);
+  long int nvertices = -1, nfaces = -1;
+  int header_len = 0;
+
+  if (success) {
+    /* The terminator appended above stops sscanf at the end of the file */
+    if (sscanf((const char *)&*ply.data, format, &nvertices, &nfaces,
+               &header_len) != 2 || header_len == 0 ||
+        nvertices < 0 || nfaces < 0) {
+      fprintf(stderr, "Bad header in '%s'\n", ply_file);
+      success = false;
+    } else if (nvertices != obj.nvertices || nfaces != obj.nfaces) {
+      fprintf(stderr, "'%s' has %ld vertices and %ld faces but '%s' has "
+              "%ld and %ld\n", ply_file, nvertices, nfaces, obj_file,
+              obj.nvertices, obj.nfaces);
+      success = false;
+    }
+    --ply.len;
+  }
+
+  const unsigned char *const vertices = &*ply.data + header_len;
+  size_t pos = (size_t)header_len + ((size_t)nvertices * 12);
+  if (success && pos > ply.len) {
+    fprintf(stderr, "'%s' is too short for its vertices\n", ply_file);
+    success = false;
+  }
+
+  const unsigned char *const obj_faces = &*obj.faces.data;
+  size_t obj_pos = 0;
+  for (long int f = 0; success && f < nfaces; ++f) {
+    long int obj_nsides;
+    memcpy(&obj_nsides, obj_faces + obj_pos, sizeof(obj_nsides));
+    obj_pos += sizeof(obj_nsides);
+
+    if (pos >= ply.len || ply.data[pos] != obj_nsides ||
+        ply.len - pos < 1 + ((size_t)obj_nsides * 4) + 1 + 4) {
+      fprintf(stderr, "Face %ld of '%s' doesn't have %ld sides\n",
+              f, ply_file, obj_nsides);
+      success = false;
+      break;
+    }
+    ++pos;
+
+    for (long int s = 0; success && s < obj_nsides; ++s) {
+      long int v;
+      memcpy(&v, obj_faces + obj_pos, sizeof(v));
+      obj_pos += sizeof(v);
+
+      int32_t const index = decode_int32(&*ply.data + pos);
+      pos += 4;
+
+      double coords[3];
+      memcpy(coords, &*obj.coords.data + ((size_t)v * sizeof(coords)),
+             sizeof(coords));
+      for (size_t i = 0; success && i < ARRAY_SIZE(coords); ++i) {
+        if (index < 0 || index >= nvertices ||
+            decode_float(vertices + ((size_t)index * 12) + (i * 4)) !=
+              (float)coords[i]) {
+          fprintf(stderr, "Side %ld of face %ld of '%s' doesn't match\n",
+                  s, f, ply_file);
+          success = false;
+        }
+      }
+    }
+    pos += 1 + 4; /* colour and object number */
+  }
+
+  if (success && pos != ply.len) {
+    fprintf(stderr, "'%s' has %zu bytes after its faces\n", ply_file,
+            ply.len - pos);
+    success = false;
+  }
+
+  obj_summary_free(&obj);
+  byte_buffer_free(&ply);
+  return success;
+}
+
+int main(int argc, const char *argv[])
+{
+  assert(argc > 0);
+  assert(argv != NULL);
+
+  bool success;
+  if (argc == 4 && !strcmp(argv[1], "-faces")) {
+    success = check_faces(argv[2], argv[3]);
+  } else if (argc == 4 && !strcmp(argv[1], "-glb")) {
+    success = check_glb(argv[2], argv[3]);
+  } else if (argc == 4 && !strcmp(argv[1], "-ply")) {
+    success = check_ply(argv[2], argv[3]);
+  } else {
+    fprintf(stderr, "usage: %s -faces <obj-file> <obj-file>\n"
+            "or     %s -glb <glb-file> <obj-file>\n"
+            "or     %s -ply <ply-file> <obj-file>\n",
+            argv[0], argv[0], argv[0]);
+    success = false;
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,102 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Unit tests for OBJ-format text
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+/* 3dObjLib headers */
+#include "Coord.h"
+
+/* Local header files */
+#include "objout.h"
+#include "misc.h"
+
+/* Checks that a coordinate is formatted as by printf("%f"). */
+static bool check_coord(Coord const value)
+{
+  char expected[ObjCoordBufferSize];
+  int const n = snprintf(expected, sizeof(expected), "%f", (double)value);
+  if (n < 0 || n >= (int)sizeof(expected)) {
+    fprintf(stderr, "Failed to format %g with printf\n", (double)value);
+    return false;
+  }
+
+  char actual[ObjCoordBufferSize];
+  size_t const len = obj_format_coord(actual, value);
+  if (len != (size_t)n || memcmp(actual, expected, len) != 0) {
+    fprintf(stderr, "Formatted %g as '%.*s' instead of '%s'\n",
+            (double)value, (int)len, actual, expected);
+    return false;
+  }
+  return true;
+}
+
+int main(void)
+{
+  static const double values[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 0.1, -0.1,
+    0.0000005, -0.0000005, 0.0000015, 0.0000025, 1.0000005, 2.5e-7,
+    1e-7, -1e-7, DBL_MIN, -DBL_MIN, DBL_MIN / 2,
+    123456.5, -123456.5, 8388607.0, 8388608.0, 16777217.0,
+    999999999999999.0, -999999999999999.0, 1e15, -1e15, 1e15 + 1.0,
+    9007199254740992.0, 9007199254740993.0, 1e18, -1e18,
+    9.2233720368547758e18, -9.2233720368547758e18, 1e19, 1e300,
+    DBL_MAX, -DBL_MAX,
+  };
+
+  bool success = true;
+
+  for (size_t i = 0; i < ARRAY_SIZE(values); ++i) {
+    if (!check_coord((Coord)values[i])) {
+      success = false;
+    }
+  }
+
+  if (!check_coord((Coord)HUGE_VAL) || !check_coord((Coord)-HUGE_VAL)) {
+    success = false;
+  }
+
+  /* Whole numbers either side of zero and the largest fast-path value */
+  for (int i = -1000; i <= 1000; ++i) {
+    if (!check_coord((Coord)i) || !check_coord((Coord)(1e15 + i)) ||
+        !check_coord((Coord)(-1e15 + i)) || !check_coord((Coord)i / 8)) {
+      success = false;
+    }
+  }
+
+  /* Halves of odd numbers are ties when rounded to whole numbers, but
+     "%f" keeps six decimal places */
+  for (long long int i = 1; i < 1000000; i = i * 3 + 1) {
+    if (!check_coord((Coord)i + (Coord)0.5) ||
+        !check_coord(-(Coord)i - (Coord)0.5)) {
+      success = false;
+    }
+  }
+
+  if (success) {
+    puts("objout tests passed");
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
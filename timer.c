@@ -0,0 +1,51 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  High-resolution monotonic clock
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifdef USE_CLOCK_GETTIME
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* ISO library header files */
+#include <time.h>
+
+#if !defined(USE_CLOCK_GETTIME) && defined(_WIN32)
+/* Windows header files */
+#include <windows.h>
+#endif
+
+/* Local header files */
+#include "timer.h"
+#include "misc.h"
+
+double timer_now(void)
+{
+#if defined(USE_CLOCK_GETTIME)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+  }
+#elif defined(_WIN32)
+  LARGE_INTEGER freq, count;
+  if (QueryPerformanceFrequency(&freq) && QueryPerformanceCounter(&count)) {
+    return (double)count.QuadPart / (double)freq.QuadPart;
+  }
+#endif
+  return (double)clock() / CLOCKS_PER_SEC;
+}
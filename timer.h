@@ -0,0 +1,14 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  High-resolution monotonic clock
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+/* Gets the time in seconds since an arbitrary point, from a monotonic
+   clock if the platform has one (otherwise from the CPU time). */
+double timer_now(void);
+
+#endif /* TIMER_H */
@@ -0,0 +1,161 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Trace of the conversion pipeline in Chrome's trace event format
+ *  Copyright (C) 2020 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#if defined(USE_PTHREADS)
+#include <pthread.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+/* Local header files */
+#include "trace.h"
+#include "bytebuf.h"
+#include "timer.h"
+#include "jobs.h"
+#include "misc.h"
+
+struct ApocTrace {
+  ByteBuffer events; /* comma-separated JSON objects */
+  double origin;     /* time of the start of the trace */
+  bool failed;       /* some events were lost */
+#if defined(USE_PTHREADS)
+  pthread_mutex_t mutex;
+#elif defined(_WIN32)
+  CRITICAL_SECTION mutex;
+#endif
+};
+
+_Optional ApocTrace *apoc_trace_create(void)
+{
+  _Optional ApocTrace *const trace = malloc(sizeof(*trace));
+  if (trace == NULL) {
+    fputs("Failed to allocate memory for trace\n", stderr);
+    return NULL;
+  }
+
+  byte_buffer_init(&trace->events);
+  trace->origin = timer_now();
+  trace->failed = false;
+#if defined(USE_PTHREADS)
+  pthread_mutex_init(&trace->mutex, NULL);
+#elif defined(_WIN32)
+  InitializeCriticalSection(&trace->mutex);
+#endif
+  return trace;
+}
+
+void apoc_trace_destroy(_Optional ApocTrace *const trace)
+{
+  if (trace == NULL) {
+    return;
+  }
+
+#if defined(USE_PTHREADS)
+  pthread_mutex_destroy(&trace->mutex);
+#elif defined(_WIN32)
+  DeleteCriticalSection(&trace->mutex);
+#endif
+  byte_buffer_free(&trace->events);
+  free(trace);
+}
+
+/* Appends a string with any characters that are special in JSON escaped,
+   e.g. backslashes in Windows file paths. */
+static bool append_escaped(ByteBuffer * const buf, const char *s)
+{
+  assert(buf != NULL);
+  assert(s != NULL);
+
+  for (; *s != '\0'; ++s) {
+    unsigned char const c = (unsigned char)*s;
+    bool const ok = (c == '"' || c == '\\') ?
+                      byte_buffer_printf(buf, "\\%c", c) :
+                    c < ' ' ? byte_buffer_printf(buf, "\\u%04x", c) :
+                              byte_buffer_append(buf, s, 1);
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void apoc_trace_span(ApocTrace * const trace, const char * const category,
+                     const char * const name, int const object,
+                     double const start, double const end)
+{
+  assert(trace != NULL);
+  assert(category != NULL);
+  assert(name != NULL);
+
+  unsigned long const tid = jobs_thread_id();
+
+#if defined(USE_PTHREADS)
+  pthread_mutex_lock(&trace->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&trace->mutex);
+#endif
+
+  ByteBuffer *const buf = &trace->events;
+  bool ok = (buf->len == 0 || byte_buffer_append(buf, ",\n", 2)) &&
+            byte_buffer_printf(buf, "{\"name\":\"") &&
+            append_escaped(buf, name) &&
+            byte_buffer_printf(buf, "\",\"cat\":\"%s\",\"ph\":\"X\","
+                               "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,"
+                               "\"tid\":%lu", category,
+                               (start - trace->origin) * 1e6,
+                               (end - start) * 1e6, tid);
+  if (ok && object >= 0) {
+    ok = byte_buffer_printf(buf, ",\"args\":{\"object\":%d}", object);
+  }
+  if (ok) {
+    ok = byte_buffer_append(buf, "}", 1);
+  }
+  if (!ok) {
+    trace->failed = true;
+  }
+
+#if defined(USE_PTHREADS)
+  pthread_mutex_unlock(&trace->mutex);
+#elif defined(_WIN32)
+  LeaveCriticalSection(&trace->mutex);
+#endif
+}
+
+bool apoc_trace_write(const ApocTrace * const trace, FILE * const out)
+{
+  assert(trace != NULL);
+  assert(out != NULL);
+
+  if (trace->failed) {
+    fputs("Warning: failed to allocate memory for some trace events\n",
+          stderr);
+  }
+
+  return fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n",
+               out) >= 0 &&
+         (trace->events.len == 0 ||
+          fwrite(&*trace->events.data, trace->events.len, 1, out) == 1) &&
+         fputs("\n]}\n", out) >= 0;
+}
@@ -0,0 +1,34 @@
+/*
+ *  ApoctoObj - Converts Apocalypse graphics to Wavefront format
+ *  Trace of the conversion pipeline in Chrome's trace event format
+ *  Copyright (C) 2020 Christopher Bazley
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* ISO C library headers */
+#include <stdbool.h>
+#include <stdio.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Spans of time which can be added from any thread. */
+typedef struct ApocTrace ApocTrace;
+
+_Optional ApocTrace *apoc_trace_create(void);
+void apoc_trace_destroy(_Optional ApocTrace *trace);
+
+/* Adds a span from start to end (as returned by timer_now) on the track
+   of the calling thread. If object is not negative then it is recorded as
+   an argument of the span. */
+void apoc_trace_span(ApocTrace *trace, const char *category,
+                     const char *name, int object, double start,
+                     double end);
+
+/* Writes all spans as a JSON object for chrome://tracing or Perfetto. */
+bool apoc_trace_write(const ApocTrace *trace, FILE *out);
+
+#endif /* TRACE_H */
@@ -7,6 +7,6 @@
 #ifndef VERSION_H
 #define VERSION_H
 
-#define VERSION_STRING "0.06 [11 May 2025]"
+#define VERSION_STRING "0.07 [16 Oct 2026]"
 
 #endif /* VERSION_H */